@@ -0,0 +1,531 @@
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <batchStitching.h>
+#include <pipelineContext.h>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+// Just enough JSON for a manifest: objects, arrays, strings and scalars, which are kept as their text
+struct JsonValue
+{
+    enum class Kind { SCALAR, STRING, ARRAY, OBJECT };
+    Kind kind = Kind::SCALAR;
+    std::string text;
+    std::vector<JsonValue> items;
+    std::vector<std::pair<std::string, JsonValue>> members;
+};
+
+class JsonParser
+{
+public:
+    explicit JsonParser(const std::string &text) : text(text), pos(0) {}
+
+    JsonValue parse()
+    {
+        JsonValue root = value();
+        skipWhitespace();
+        if (pos != text.size())
+            fail("trailing characters");
+        return root;
+    }
+
+private:
+    [[noreturn]] void fail(const std::string &what) const
+    {
+        throw std::invalid_argument("Invalid manifest JSON, " + what + " at offset " + std::to_string(pos));
+    }
+
+    void skipWhitespace()
+    {
+        while (pos < text.size() && std::isspace(static_cast<unsigned char>(text[pos])))
+            ++pos;
+    }
+
+    bool consume(char c)
+    {
+        skipWhitespace();
+        if (pos < text.size() && text[pos] == c)
+        {
+            ++pos;
+            return true;
+        }
+        return false;
+    }
+
+    void expect(char c)
+    {
+        if (!consume(c))
+            fail(std::string("expected '") + c + "'");
+    }
+
+    std::string string()
+    {
+        expect('"');
+        std::string s;
+        while (pos < text.size() && text[pos] != '"')
+        {
+            char c = text[pos++];
+            if (c == '\\')
+            {
+                if (pos >= text.size())
+                    fail("unterminated escape");
+                c = text[pos++];
+                switch (c)
+                {
+                case 'n': c = '\n'; break;
+                case 't': c = '\t'; break;
+                case 'r': c = '\r'; break;
+                case 'b': c = '\b'; break;
+                case 'f': c = '\f'; break;
+                case 'u': fail("\\u escapes are not supported");
+                default: break;
+                }
+            }
+            s += c;
+        }
+        expect('"');
+        return s;
+    }
+
+    JsonValue value()
+    {
+        skipWhitespace();
+        if (pos >= text.size())
+            fail("unexpected end");
+
+        JsonValue v;
+        if (text[pos] == '{')
+        {
+            v.kind = JsonValue::Kind::OBJECT;
+            ++pos;
+            if (consume('}'))
+                return v;
+            do
+            {
+                std::string key = string();
+                expect(':');
+                v.members.emplace_back(key, value());
+            } while (consume(','));
+            expect('}');
+        }
+        else if (text[pos] == '[')
+        {
+            v.kind = JsonValue::Kind::ARRAY;
+            ++pos;
+            if (consume(']'))
+                return v;
+            do
+            {
+                v.items.push_back(value());
+            } while (consume(','));
+            expect(']');
+        }
+        else if (text[pos] == '"')
+        {
+            v.kind = JsonValue::Kind::STRING;
+            v.text = string();
+        }
+        else
+        {
+            const size_t end = text.find_first_of(",]} \t\r\n", pos);
+            v.text = text.substr(pos, end == std::string::npos ? std::string::npos : end - pos);
+            pos = end == std::string::npos ? text.size() : end;
+        }
+        return v;
+    }
+
+    const std::string &text;
+    size_t pos;
+};
+
+std::string lowercase(std::string text)
+{
+    std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return text;
+}
+
+std::string trim(const std::string &text)
+{
+    const size_t begin = text.find_first_not_of(" \t\r\n");
+    if (begin == std::string::npos)
+        return "";
+    return text.substr(begin, text.find_last_not_of(" \t\r\n") - begin + 1);
+}
+
+std::string resolvePath(const fs::path &base, const std::string &path)
+{
+    const fs::path p(path);
+    return p.is_absolute() ? path : (base / p).lexically_normal().string();
+}
+
+void applyField(BatchJob &job, const std::string &key, const std::string &value, const fs::path &base)
+{
+    if (key == "image1")
+        job.image1 = resolvePath(base, value);
+    else if (key == "image2")
+        job.image2 = resolvePath(base, value);
+    else if (key == "output")
+        job.output = resolvePath(base, value);
+    else if (key == "threshold")
+        job.threshold = std::stof(value);
+    else if (key == "method")
+    {
+        const std::string method = lowercase(value);
+        if (method == "sift")
+            job.method = FeatureDetectorMethod::SIFT;
+        else if (method == "orb")
+            job.method = FeatureDetectorMethod::ORB;
+        else
+            throw std::invalid_argument("Unknown feature detector method " + value);
+    }
+    else if (key == "stitching")
+    {
+        const std::string stitching = lowercase(value);
+        if (stitching == "overlay")
+            job.stitching = StitchingMethod::OVERLAY;
+        else if (stitching == "feathering")
+            job.stitching = StitchingMethod::FEATHERING;
+        else if (stitching == "multiband")
+            job.stitching = StitchingMethod::MULTIBAND;
+        else
+            throw std::invalid_argument("Unknown stitching method " + value);
+    }
+    else
+        throw std::invalid_argument("Unknown manifest field " + key);
+}
+
+void checkJob(const BatchJob &job, const std::string &manifest)
+{
+    if (job.image1.empty() || job.image2.empty())
+    {
+        throw std::invalid_argument("Every job in " + manifest + " needs image1 and image2");
+    }
+}
+
+// '*' matches any run of characters, '?' any single one
+bool wildcardMatch(const char *pattern, const char *text)
+{
+    if (*pattern == '\0')
+        return *text == '\0';
+    if (*pattern == '*')
+        return wildcardMatch(pattern + 1, text) || (*text != '\0' && wildcardMatch(pattern, text + 1));
+    return *text != '\0' && (*pattern == '?' || *pattern == *text) && wildcardMatch(pattern + 1, text + 1);
+}
+
+std::vector<BatchJob> jobsFromDirectory(const fs::path &directory, const std::string &pattern, const BatchJob &defaults)
+{
+    static const char *imageExtensions[] = {".jpg", ".jpeg", ".png", ".bmp", ".tif", ".tiff"};
+    // Sorted by name, so jobs run in a stable order
+    std::map<std::string, std::pair<std::string, std::string>> pairs;
+    for (const auto &entry : fs::directory_iterator(directory))
+    {
+        if (!entry.is_regular_file())
+            continue;
+        const std::string filename = entry.path().filename().string();
+        const std::string extension = lowercase(entry.path().extension().string());
+        const bool selected = pattern.empty() ? std::find(std::begin(imageExtensions), std::end(imageExtensions), extension) != std::end(imageExtensions)
+                                              : wildcardMatch(pattern.c_str(), filename.c_str());
+        const std::string stem = entry.path().stem().string();
+        if (!selected || stem.size() < 3 || stem[stem.size() - 2] != '_')
+            continue;
+        if (stem.back() == '1')
+            pairs[stem.substr(0, stem.size() - 2)].first = entry.path().string();
+        else if (stem.back() == '2')
+            pairs[stem.substr(0, stem.size() - 2)].second = entry.path().string();
+    }
+
+    std::vector<BatchJob> jobs;
+    for (const auto &pair : pairs)
+    {
+        if (pair.second.first.empty() || pair.second.second.empty())
+            continue;
+        BatchJob job = defaults;
+        job.image1 = pair.second.first;
+        job.image2 = pair.second.second;
+        job.output.clear();
+        jobs.push_back(job);
+    }
+    if (jobs.empty())
+    {
+        throw std::invalid_argument("No image pairs <name>_1 / <name>_2 found in " + directory.string());
+    }
+    return jobs;
+}
+
+std::vector<BatchJob> jobsFromCsv(const fs::path &path, const BatchJob &defaults)
+{
+    std::ifstream in(path);
+    if (!in)
+    {
+        throw std::runtime_error("Could not read manifest " + path.string());
+    }
+    static const char *columns[] = {"image1", "image2", "method", "threshold", "stitching", "output"};
+    const int numColumns = static_cast<int>(sizeof(columns) / sizeof(columns[0]));
+
+    std::vector<BatchJob> jobs;
+    std::string line;
+    while (std::getline(in, line))
+    {
+        std::vector<std::string> fields;
+        std::stringstream row(line.substr(0, line.find('#')));
+        std::string field;
+        while (std::getline(row, field, ','))
+        {
+            fields.push_back(trim(field));
+        }
+        if (fields.empty() || (fields.size() == 1 && fields[0].empty()) || fields[0] == "image1")
+            continue;
+
+        BatchJob job = defaults;
+        for (int k = 0; k < std::min(numColumns, static_cast<int>(fields.size())); ++k)
+        {
+            if (!fields[k].empty())
+                applyField(job, columns[k], fields[k], path.parent_path());
+        }
+        checkJob(job, path.string());
+        jobs.push_back(job);
+    }
+    return jobs;
+}
+
+const std::string &scalarText(const JsonValue &value, const std::string &key)
+{
+    if (value.kind == JsonValue::Kind::ARRAY || value.kind == JsonValue::Kind::OBJECT)
+    {
+        throw std::invalid_argument("Manifest field " + key + " must be a string or a number");
+    }
+    return value.text;
+}
+
+std::vector<BatchJob> jobsFromJson(const fs::path &path, const BatchJob &defaults)
+{
+    std::ifstream in(path);
+    if (!in)
+    {
+        throw std::runtime_error("Could not read manifest " + path.string());
+    }
+    std::stringstream buffer;
+    buffer << in.rdbuf();
+    const std::string text = buffer.str();
+    const JsonValue root = JsonParser(text).parse();
+
+    BatchJob shared = defaults;
+    const JsonValue *list = &root;
+    if (root.kind == JsonValue::Kind::OBJECT)
+    {
+        list = nullptr;
+        for (const auto &member : root.members)
+        {
+            if (member.first == "jobs")
+                list = &member.second;
+            else
+                applyField(shared, member.first, scalarText(member.second, member.first), path.parent_path());
+        }
+    }
+    if (!list || list->kind != JsonValue::Kind::ARRAY)
+    {
+        throw std::invalid_argument("Manifest " + path.string() + " has no jobs array");
+    }
+
+    std::vector<BatchJob> jobs;
+    for (const auto &item : list->items)
+    {
+        if (item.kind != JsonValue::Kind::OBJECT)
+        {
+            throw std::invalid_argument("Every job in " + path.string() + " must be an object");
+        }
+        BatchJob job = shared;
+        for (const auto &member : item.members)
+        {
+            applyField(job, member.first, scalarText(member.second, member.first), path.parent_path());
+        }
+        checkJob(job, path.string());
+        jobs.push_back(job);
+    }
+    return jobs;
+}
+
+std::string stitchingName(StitchingMethod stitching)
+{
+    switch (stitching)
+    {
+    case StitchingMethod::OVERLAY: return "overlay";
+    case StitchingMethod::FEATHERING: return "feathering";
+    case StitchingMethod::FEATHERING_LEGACY: return "feathering_legacy";
+    case StitchingMethod::MULTIBAND: return "multiband";
+    default: return "unknown";
+    }
+}
+
+// Every field that changes the panorama is part of the name, so jobs sweeping a parameter over one pair do not collide
+std::string defaultOutput(const BatchJob &job, const std::string &outputDirectory)
+{
+    const std::string method = job.method == FeatureDetectorMethod::ORB ? "orb" : "sift";
+    std::ostringstream name;
+    name << fs::path(job.image1).stem().string() << "_" << fs::path(job.image2).stem().string() << "_" << method << "_t" << job.threshold
+         << "_" << stitchingName(job.stitching) << ".jpg";
+    return (fs::path(outputDirectory) / name.str()).string();
+}
+
+// The output exists and is newer than both inputs
+bool upToDate(const BatchJob &job, const std::string &output)
+{
+    std::error_code error;
+    const auto outputTime = fs::last_write_time(output, error);
+    if (error)
+        return false;
+    for (const std::string &input : {job.image1, job.image2})
+    {
+        const auto inputTime = fs::last_write_time(input, error);
+        if (error || inputTime > outputTime)
+            return false;
+    }
+    return true;
+}
+
+struct JobState
+{
+    cv::Mat image1, image2, panorama;
+};
+}
+
+std::vector<BatchJob> loadManifest(const std::string &manifest, const BatchJob &defaults)
+{
+    const fs::path path(manifest);
+    if (fs::is_directory(path))
+        return jobsFromDirectory(path, "", defaults);
+
+    const std::string filename = path.filename().string();
+    if (filename.find_first_of("*?") != std::string::npos)
+        return jobsFromDirectory(path.has_parent_path() ? path.parent_path() : fs::path("."), filename, defaults);
+
+    const std::string extension = lowercase(path.extension().string());
+    if (extension == ".csv")
+        return jobsFromCsv(path, defaults);
+    if (extension == ".json")
+        return jobsFromJson(path, defaults);
+    throw std::invalid_argument("Unsupported manifest " + manifest + ", expected a directory, a glob, .csv or .json");
+}
+
+BatchStats runBatch(const std::vector<BatchJob> &jobs, const BatchOptions &options)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+    const int n = static_cast<int>(jobs.size());
+    BatchStats stats;
+    stats.numJobs = n;
+    stats.jobs.resize(n);
+    std::vector<JobState> states(n);
+
+    // Runs one step of job i unless an earlier step failed, recording instead of propagating its failure
+    auto guarded = [&](int i, const std::function<void()> &step)
+    {
+        BatchJobResult &result = stats.jobs[i];
+        if (result.failed)
+            return;
+        try
+        {
+            step();
+        }
+        catch (const std::exception &e)
+        {
+            result.failed = true;
+            result.error = e.what();
+            states[i] = JobState();
+        }
+    };
+
+    ThreadPool pool(options.numWorkers);
+    const size_t window = static_cast<size_t>(std::max(1, options.pairsInFlightPerWorker)) * pool.size();
+    TaskGraph graph;
+    std::vector<int> stitchTasks;
+    // Two jobs writing one file would race in imwrite and later skip each other as up to date,
+    // so only the first job naming an output keeps it
+    std::map<std::string, int> outputOwners;
+    for (int i = 0; i < n; ++i)
+    {
+        const BatchJob &job = jobs[i];
+        BatchJobResult &result = stats.jobs[i];
+        result.output = job.output.empty() ? defaultOutput(job, options.outputDirectory) : job.output;
+        const std::string key = fs::absolute(result.output).lexically_normal().string();
+        const auto owner = outputOwners.emplace(key, i);
+        if (!owner.second)
+        {
+            result.failed = true;
+            result.error = "Output " + result.output + " is also written by job " + std::to_string(owner.first->second);
+            continue;
+        }
+        if (!options.force && upToDate(job, result.output))
+        {
+            result.skipped = true;
+            continue;
+        }
+        const fs::path directory = fs::path(result.output).parent_path();
+        if (!directory.empty())
+            fs::create_directories(directory);
+
+        // A pair is only decoded once the pair `window` places before it has been stitched
+        std::vector<int> dependencies;
+        if (stitchTasks.size() >= window)
+            dependencies.push_back(stitchTasks[stitchTasks.size() - window]);
+
+        int decode = graph.add("decode", [&, i] {
+            guarded(i, [&] {
+                states[i].image1 = load_image(jobs[i].image1);
+                states[i].image2 = load_image(jobs[i].image2);
+            });
+        }, dependencies);
+        int stitch = graph.add("stitch", [&, i] {
+            guarded(i, [&] {
+                thread_local PipelineContext context;
+                PairOptions pairOptions;
+                pairOptions.method = jobs[i].method;
+                pairOptions.threshold = jobs[i].threshold;
+                pairOptions.stitching = jobs[i].stitching;
+                PairResult pair = stitchPair(context, states[i].image1, states[i].image2, pairOptions);
+                if (pair.panorama.empty())
+                {
+                    throw std::runtime_error("No homography found");
+                }
+                // The panorama is a view of this worker's canvas, which its next pair overwrites
+                states[i].panorama = pair.panorama.clone();
+                stats.jobs[i].numInliers = pair.homography.numInliers;
+                states[i].image1.release();
+                states[i].image2.release();
+            });
+        }, {decode});
+        graph.add("encode", [&, i] {
+            guarded(i, [&] {
+                if (!cv::imwrite(stats.jobs[i].output, states[i].panorama))
+                {
+                    throw std::runtime_error("Could not write " + stats.jobs[i].output);
+                }
+                states[i].panorama.release();
+            });
+        }, {stitch});
+        stitchTasks.push_back(stitch);
+    }
+    graph.run(pool);
+
+    for (const auto &result : stats.jobs)
+    {
+        if (result.skipped)
+            ++stats.numSkipped;
+        else if (result.failed)
+            ++stats.numFailed;
+        else
+            ++stats.numProcessed;
+    }
+    stats.stages = graph.stageMetrics();
+    stats.wallTimeMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    stats.pairsPerSecond = stats.wallTimeMs > 0.0 ? stats.numProcessed * 1000.0 / stats.wallTimeMs : 0.0;
+    return stats;
+}
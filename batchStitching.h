@@ -0,0 +1,61 @@
+#pragma once
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+#include "featureDetection.h"
+#include "warping.h"
+#include "taskGraph.h"
+
+struct BatchJob {
+    std::string image1;
+    std::string image2;
+    FeatureDetectorMethod method = FeatureDetectorMethod::SIFT;
+    float threshold = 5.0f;
+    StitchingMethod stitching = StitchingMethod::FEATHERING;
+    // <output directory>/<image1 stem>_<image2 stem>_<method>_t<threshold>_<stitching>.jpg when empty.
+    // A job whose output an earlier job of the batch already writes fails instead of overwriting it.
+    std::string output;
+};
+
+struct BatchOptions {
+    std::string outputDirectory = "../outputs/batch";
+    // 0 uses one worker per hardware thread
+    unsigned numWorkers = 0;
+    // Decoded pairs waiting for a stitch worker, per worker; bounds the memory of a long job list
+    int pairsInFlightPerWorker = 2;
+    // Re-stitch pairs whose output is newer than both inputs
+    bool force = false;
+};
+
+struct BatchJobResult {
+    std::string output;
+    bool skipped = false;
+    bool failed = false;
+    std::string error;
+    int numInliers = 0;
+};
+
+struct BatchStats {
+    int numJobs = 0;
+    int numProcessed = 0;
+    int numSkipped = 0;
+    int numFailed = 0;
+    double wallTimeMs = 0.0;
+    // Stitched pairs per second of wall time, skipped and failed jobs excluded
+    double pairsPerSecond = 0.0;
+    std::vector<BatchJobResult> jobs;
+    std::vector<StageMetrics> stages;
+};
+
+// Jobs from a manifest, which is one of
+//  - a directory or a file glob such as ../images/*.jpg: files named <name>_1.<ext> and <name>_2.<ext> form a pair
+//  - a .csv file with the columns image1,image2[,method[,threshold[,stitching[,output]]]], '#' starts a comment
+//  - a .json file {"method": ..., "jobs": [{"image1": ..., "image2": ..., ...}]}, or just the jobs array;
+//    top-level fields are defaults for every job
+// Relative paths inside a file are relative to the file. Fields a job leaves out come from defaults.
+std::vector<BatchJob> loadManifest(const std::string &manifest, const BatchJob &defaults = BatchJob());
+
+// Stitch every job on a bounded pool: decode, stitch and encode are separate tasks, so image I/O of one
+// pair overlaps the stitching of others. Each worker reuses its own PipelineContext across pairs.
+// A failing job is recorded in its BatchJobResult and does not stop the others.
+BatchStats runBatch(const std::vector<BatchJob> &jobs, const BatchOptions &options = BatchOptions());
@@ -0,0 +1,89 @@
+#include <iostream>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <opencv2/opencv.hpp>
+#include <featureDetection.h>
+#include <warping.h>
+
+// Compares MULTIBAND against FEATHERING blending on the sample image pairs: best-of-N stage timings and peak
+// resident memory of each method.
+// Usage: blending_benchmark [repetitions] [image1 image2]...
+
+// A memory field of /proc/self/status in KiB, e.g. "VmRSS:" or the peak "VmHWM:"
+static long statusKiB(const std::string &field)
+{
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line))
+    {
+        if (line.rfind(field, 0) == 0)
+            return std::stol(line.substr(field.size()));
+    }
+    return 0;
+}
+
+// Resets VmHWM to the current RSS (Linux >= 4.0), so the next peak is attributed to one method only
+static void resetPeakRss()
+{
+    std::ofstream clearRefs("/proc/self/clear_refs");
+    clearRefs << "5";
+}
+
+int main(int argc, char **argv)
+{
+    const int repetitions = argc > 1 ? std::atoi(argv[1]) : 10;
+    std::vector<std::string> paths;
+    for (int i = 2; i + 1 < argc; i += 2)
+    {
+        paths.push_back(argv[i]);
+        paths.push_back(argv[i + 1]);
+    }
+    if (paths.empty())
+    {
+        paths = {"../images/1_1.jpg", "../images/1_2.jpg", "../images/2_1.jpg", "../images/2_2.jpg", "../images/3_1.jpg", "../images/3_2.jpg"};
+    }
+
+    const std::pair<StitchingMethod, const char *> methods[] = {{StitchingMethod::FEATHERING, "FEATHERING"}, {StitchingMethod::MULTIBAND, "MULTIBAND"}};
+    std::cout << "pair\tmethod\twarp ms\tblend ms\ttotal ms\tpeak extra MiB" << std::endl;
+
+    for (size_t p = 0; p + 1 < paths.size(); p += 2)
+    {
+        cv::Mat image1 = cv::imread(paths[p]), image2 = cv::imread(paths[p + 1]);
+        if (image1.empty() || image2.empty())
+        {
+            std::cerr << "skipping " << paths[p] << " / " << paths[p + 1] << ": could not load" << std::endl;
+            continue;
+        }
+        ImageFeatures features1 = extract_features(image1);
+        ImageFeatures features2 = extract_features(image2);
+        FeatureMatches matches = match_features(features2, features1);
+        HomographyEstimation homography = estimateHomography(features2.keypoints, features1.keypoints, matches, 5.0);
+
+        for (const auto &method : methods)
+        {
+            // Best-of-N timing hides first-run allocations, while the peak still includes the retained pyramid buffers
+            const long baseline = statusKiB("VmRSS:");
+            resetPeakRss();
+            StitchingTimings best = {0.0, 0.0, 0.0};
+            double bestTotal = 0.0;
+            for (int r = 0; r < repetitions; ++r)
+            {
+                StitchingTimings timings;
+                cv::Mat stitched = stitchImages(image1, image2, homography.H, method.first, &timings);
+                const double total = timings.warpTimeMs + timings.overlapTimeMs + timings.blendTimeMs;
+                if (r == 0 || total < bestTotal)
+                {
+                    best = timings;
+                    bestTotal = total;
+                }
+            }
+            const double extraMiB = (statusKiB("VmHWM:") - baseline) / 1024.0;
+
+            std::cout << p / 2 + 1 << "\t" << method.second << "\t" << best.warpTimeMs << "\t"
+                      << best.overlapTimeMs + best.blendTimeMs << "\t" << bestTotal << "\t" << extraMiB << std::endl;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,69 @@
+#include <iostream>
+#include <cstdlib>
+#include <opencv2/opencv.hpp>
+#include <hammingMatcher.h>
+
+// Compares HammingMatcher against cv::BFMatcher(cv::NORM_HAMMING) on random 32-byte (ORB-sized) descriptors.
+// Usage: hamming_benchmark [max train descriptors]
+
+static double timeKnnMatch(cv::DescriptorMatcher &matcher, const cv::Mat &query, std::vector<std::vector<cv::DMatch>> &matches, int repetitions)
+{
+    double best = 0.0;
+    for (int r = 0; r < repetitions; ++r)
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        matcher.knnMatch(query, matches, 2);
+        auto end = std::chrono::high_resolution_clock::now();
+        double elapsed = std::chrono::duration<double, std::milli>(end - start).count();
+        best = r == 0 ? elapsed : std::min(best, elapsed);
+    }
+    return best;
+}
+
+int main(int argc, char **argv)
+{
+    const int maxTrain = argc > 1 ? std::atoi(argv[1]) : 200000;
+    const int sizes[] = {1000, 5000, 20000, 100000, 200000};
+
+    std::cout << "kernel: " << hamming_kernel_name(32) << std::endl;
+    std::cout << "query\ttrain\tBFMatcher ms\tHammingMatcher ms\tspeedup\tidentical" << std::endl;
+
+    cv::RNG rng(42);
+    for (int numTrain : sizes)
+    {
+        if (numTrain > maxTrain)
+            break;
+        const int numQuery = std::min(numTrain, 10000);
+        cv::Mat train(numTrain, 32, CV_8U), query(numQuery, 32, CV_8U);
+        rng.fill(train, cv::RNG::UNIFORM, 0, 256);
+        rng.fill(query, cv::RNG::UNIFORM, 0, 256);
+
+        const int repetitions = numTrain <= 20000 ? 5 : 1;
+
+        cv::BFMatcher reference(cv::NORM_HAMMING);
+        reference.add(std::vector<cv::Mat>{train});
+        std::vector<std::vector<cv::DMatch>> referenceMatches;
+        double referenceMs = timeKnnMatch(reference, query, referenceMatches, repetitions);
+
+        HammingMatcher matcher;
+        matcher.add(std::vector<cv::Mat>{train});
+        std::vector<std::vector<cv::DMatch>> matches;
+        double matcherMs = timeKnnMatch(matcher, query, matches, repetitions);
+
+        // Ties may resolve to different train indices, so compare distances only
+        bool identical = matches.size() == referenceMatches.size();
+        for (size_t i = 0; identical && i < matches.size(); ++i)
+        {
+            identical = matches[i].size() == referenceMatches[i].size();
+            for (size_t j = 0; identical && j < matches[i].size(); ++j)
+            {
+                identical = matches[i][j].distance == referenceMatches[i][j].distance;
+            }
+        }
+
+        std::cout << numQuery << "\t" << numTrain << "\t" << referenceMs << "\t" << matcherMs << "\t"
+                  << referenceMs / matcherMs << "x\t" << (identical ? "yes" : "no") << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,617 @@
+#include <iostream>
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <map>
+#include <string>
+#include <opencv2/opencv.hpp>
+#include <featureDetection.h>
+#include <warping.h>
+#include <profiler.h>
+#include <pipelineContext.h>
+#include <coarseToFine.h>
+#include <bundleAdjustment.h>
+#include <videoStitching.h>
+
+// Benchmarks every stage of the pipeline on synthetic scenes with a known homography, so it runs offline and
+// gives the same inputs on every machine. Results are written as JSON, one case per line; with a baseline
+// file every case is compared against it and regressions beyond the tolerance fail the run. Cases that exercise a
+// failure path also check their counters, and a wrong result fails the run as well.
+// Usage: stitching_benchmark [--out results.json] [--baseline previous.json] [--tolerance 0.10] [--filter substring]
+
+namespace
+{
+struct BenchmarkResult
+{
+    std::string name;
+    int iterations;
+    double medianMs;
+    double minMs;
+    std::map<std::string, double> counters;
+};
+
+struct Options
+{
+    std::string outputPath = "benchmark_results.json";
+    std::string baselinePath;
+    double tolerance = 0.10;
+    std::string filter;
+};
+
+// Repeats fn until it ran at least minRepetitions times and for minTimeMs, after one untimed warm-up run
+BenchmarkResult runCase(const std::string &name, const std::function<void(std::map<std::string, double> &)> &fn)
+{
+    const int minRepetitions = 5, maxRepetitions = 50;
+    const double minTimeMs = 300.0;
+
+    BenchmarkResult result{name, 0, 0.0, 0.0, {}};
+    fn(result.counters);
+
+    std::vector<double> times;
+    double totalMs = 0.0;
+    while (static_cast<int>(times.size()) < maxRepetitions && (static_cast<int>(times.size()) < minRepetitions || totalMs < minTimeMs))
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        fn(result.counters);
+        times.push_back(std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count());
+        totalMs += times.back();
+    }
+
+    std::sort(times.begin(), times.end());
+    result.iterations = static_cast<int>(times.size());
+    result.medianMs = times[times.size() / 2];
+    result.minMs = times.front();
+    return result;
+}
+
+// Deterministic textured scene: random rectangles, circles and lines over smooth noise, so detectors
+// find plenty of distinct corners and blobs
+cv::Mat syntheticScene(cv::Size size, std::uint64_t seed)
+{
+    cv::RNG rng(seed);
+    cv::Mat scene(size, CV_8UC3);
+    rng.fill(scene, cv::RNG::UNIFORM, 0, 256);
+    cv::GaussianBlur(scene, scene, cv::Size(0, 0), 8.0);
+
+    const int shapes = size.area() / 2000;
+    for (int i = 0; i < shapes; ++i)
+    {
+        const cv::Point p(rng.uniform(0, size.width), rng.uniform(0, size.height));
+        const cv::Scalar color(rng.uniform(0, 256), rng.uniform(0, 256), rng.uniform(0, 256));
+        switch (i % 3)
+        {
+        case 0:
+            cv::rectangle(scene, p, p + cv::Point(rng.uniform(4, 40), rng.uniform(4, 40)), color, cv::FILLED);
+            break;
+        case 1:
+            cv::circle(scene, p, rng.uniform(3, 25), color, cv::FILLED);
+            break;
+        default:
+            cv::line(scene, p, p + cv::Point(rng.uniform(-50, 50), rng.uniform(-50, 50)), color, 2);
+            break;
+        }
+    }
+    return scene;
+}
+
+// Two overlapping views of one synthetic scene. image1 is the left part of the scene; image2 samples the
+// scene through homography, so stitchImages(image1, image2, homography) reconstructs it exactly.
+struct SyntheticPair
+{
+    cv::Mat image1, image2, homography;
+};
+
+SyntheticPair syntheticPair(cv::Size size, std::uint64_t seed)
+{
+    cv::Mat scene = syntheticScene(cv::Size(size.width * 8 / 5, size.height), seed);
+    SyntheticPair pair;
+    pair.image1 = scene(cv::Rect(0, 0, size.width, size.height)).clone();
+    // Shift by 60% of the width with a slight rotation and perspective
+    pair.homography = (cv::Mat_<double>(3, 3) << 0.98, -0.03, 0.6 * size.width, 0.02, 0.99, 4.0, 1e-5, -2e-5, 1.0);
+    cv::warpPerspective(scene, pair.image2, pair.homography, size, cv::INTER_LINEAR | cv::WARP_INVERSE_MAP);
+    return pair;
+}
+
+// MJPEG stream of a still frame, with the frames listed in blank replaced by black ones
+void writeSyntheticVideo(const std::string &path, const cv::Mat &frame, int numFrames, const std::vector<int> &blank)
+{
+    cv::VideoWriter writer(path, cv::VideoWriter::fourcc('M', 'J', 'P', 'G'), 30.0, frame.size());
+    if (!writer.isOpened())
+    {
+        throw std::runtime_error("Could not write video " + path);
+    }
+    const cv::Mat black = cv::Mat::zeros(frame.size(), frame.type());
+    for (int i = 0; i < numFrames; ++i)
+    {
+        writer.write(std::find(blank.begin(), blank.end(), i) != blank.end() ? black : frame);
+    }
+}
+
+// Correspondences between random points and their images under a known homography. A fraction of them
+// are replaced by random points, the rest get Gaussian noise of 0.5 px.
+void syntheticCorrespondences(int count, double outlierRatio, std::uint64_t seed, std::vector<cv::KeyPoint> &keypoints1,
+                              std::vector<cv::KeyPoint> &keypoints2, FeatureMatches &matches)
+{
+    cv::RNG rng(seed);
+    const cv::Matx33d H(1.05, 0.02, 300.0, -0.03, 0.97, 20.0, 2e-5, 1e-5, 1.0);
+    keypoints1.clear();
+    keypoints2.clear();
+    matches = FeatureMatches();
+    for (int i = 0; i < count; ++i)
+    {
+        const cv::Point2f p(rng.uniform(0.0f, 1280.0f), rng.uniform(0.0f, 720.0f));
+        const cv::Vec3d q = H * cv::Vec3d(p.x, p.y, 1.0);
+        cv::Point2f projected(static_cast<float>(q[0] / q[2]), static_cast<float>(q[1] / q[2]));
+        if (rng.uniform(0.0, 1.0) < outlierRatio)
+            projected = cv::Point2f(rng.uniform(0.0f, 1600.0f), rng.uniform(0.0f, 720.0f));
+        else
+            projected += cv::Point2f(static_cast<float>(rng.gaussian(0.5)), static_cast<float>(rng.gaussian(0.5)));
+
+        keypoints1.emplace_back(p, 1.0f);
+        keypoints2.emplace_back(projected, 1.0f);
+        const float distance = rng.uniform(0.0f, 1.0f);
+        matches.matches.emplace_back(i, i, distance);
+        matches.distances.push_back(distance);
+    }
+}
+
+// A strip of n 1280x720 views 500 px apart, with noisy correspondences between images up to two apart.
+// The initial transforms carry drift that grows along the strip, like chained pairwise estimates.
+void syntheticMosaic(int n, std::uint64_t seed, std::vector<cv::Mat> &truth, std::vector<cv::Mat> &initial, std::vector<PairCorrespondences> &pairs)
+{
+    cv::RNG rng(seed);
+    truth.assign(n, cv::Mat());
+    initial.assign(n, cv::Mat());
+    pairs.clear();
+    cv::Matx33d drift = cv::Matx33d::eye();
+    for (int i = 0; i < n; ++i)
+    {
+        const cv::Matx33d T = i == 0 ? cv::Matx33d::eye()
+                                     : cv::Matx33d(1.0, 0.01 * rng.gaussian(1.0), 500.0 * i, 0.01 * rng.gaussian(1.0), 1.0, 5.0 * rng.gaussian(1.0),
+                                                   1e-6 * rng.gaussian(1.0), 1e-6 * rng.gaussian(1.0), 1.0);
+        if (i > 0)
+            drift = drift * cv::Matx33d(1.0 + 0.002 * rng.gaussian(1.0), 0.0, 2.0 * rng.gaussian(1.0), 0.0, 1.0 + 0.002 * rng.gaussian(1.0), 2.0 * rng.gaussian(1.0), 0.0, 0.0, 1.0);
+        truth[i] = cv::Mat(T, true);
+        initial[i] = cv::Mat(T * drift, true);
+    }
+
+    for (int i = 0; i < n; ++i)
+    {
+        for (int j = i + 1; j < n && j <= i + 2; ++j)
+        {
+            PairCorrespondences pair{i, j, {}, {}};
+            const cv::Matx33d jToI = cv::Matx33d(truth[i]).inv() * cv::Matx33d(truth[j]);
+            for (int k = 0; k < 200; ++k)
+            {
+                const cv::Point2f p(rng.uniform(0.0f, 1280.0f), rng.uniform(0.0f, 720.0f));
+                const cv::Vec3d q = jToI * cv::Vec3d(p.x, p.y, 1.0);
+                const cv::Point2f projected(static_cast<float>(q[0] / q[2]), static_cast<float>(q[1] / q[2]));
+                if (projected.x < 0.0f || projected.x >= 1280.0f || projected.y < 0.0f || projected.y >= 720.0f)
+                    continue;
+                pair.points1.push_back(projected + cv::Point2f(static_cast<float>(rng.gaussian(0.5)), static_cast<float>(rng.gaussian(0.5))));
+                pair.points2.push_back(p + cv::Point2f(static_cast<float>(rng.gaussian(0.5)), static_cast<float>(rng.gaussian(0.5))));
+            }
+            pairs.push_back(pair);
+        }
+    }
+}
+
+// Query descriptors are noisy copies of the reference ones, like the same scene seen twice
+void syntheticDescriptors(FeatureDetectorMethod method, int count, std::uint64_t seed, ImageFeatures &reference, ImageFeatures &query)
+{
+    cv::RNG rng(seed);
+    if (method == FeatureDetectorMethod::SIFT)
+    {
+        reference.descriptors.create(count, 128, CV_32F);
+        rng.fill(reference.descriptors, cv::RNG::UNIFORM, 0.0f, 255.0f);
+        cv::Mat noise(count, 128, CV_32F);
+        rng.fill(noise, cv::RNG::NORMAL, 0.0f, 8.0f);
+        query.descriptors = reference.descriptors + noise;
+    }
+    else
+    {
+        reference.descriptors.create(count, 32, CV_8U);
+        rng.fill(reference.descriptors, cv::RNG::UNIFORM, 0, 256);
+        query.descriptors = reference.descriptors.clone();
+        for (int i = 0; i < count; ++i)
+        {
+            // Flip a few bits per descriptor
+            for (int flips = 0; flips < 8; ++flips)
+            {
+                query.descriptors.at<uchar>(i, rng.uniform(0, 32)) ^= static_cast<uchar>(1 << rng.uniform(0, 8));
+            }
+        }
+    }
+}
+
+std::string methodName(FeatureDetectorMethod method)
+{
+    return method == FeatureDetectorMethod::SIFT ? "SIFT" : "ORB";
+}
+
+std::string sizeName(cv::Size size)
+{
+    return std::to_string(size.width) + "x" + std::to_string(size.height);
+}
+
+// Mean distance in px between image2's corners mapped by an estimate and by the true homography
+double cornerError(const cv::Mat &estimate, const cv::Mat &truth, cv::Size size)
+{
+    if (estimate.empty())
+        return std::numeric_limits<double>::infinity();
+    const std::vector<cv::Point2f> corners = {{0.0f, 0.0f}, {static_cast<float>(size.width), 0.0f},
+                                              {static_cast<float>(size.width), static_cast<float>(size.height)}, {0.0f, static_cast<float>(size.height)}};
+    std::vector<cv::Point2f> estimated, expected;
+    cv::perspectiveTransform(corners, estimated, estimate);
+    cv::perspectiveTransform(corners, expected, truth);
+    double error = 0.0;
+    for (size_t i = 0; i < corners.size(); ++i)
+    {
+        error += cv::norm(estimated[i] - expected[i]);
+    }
+    return error / corners.size();
+}
+
+// Reads the median times of a file written by writeResults
+std::map<std::string, double> readBaseline(const std::string &path)
+{
+    std::ifstream in(path);
+    if (!in)
+    {
+        throw std::runtime_error("Could not read baseline " + path);
+    }
+    std::map<std::string, double> medians;
+    std::string line;
+    while (std::getline(in, line))
+    {
+        const size_t namePos = line.find("\"name\": \"");
+        const size_t medianPos = line.find("\"median_ms\": ");
+        if (namePos == std::string::npos || medianPos == std::string::npos)
+            continue;
+        const size_t nameStart = namePos + 9;
+        const std::string name = line.substr(nameStart, line.find('"', nameStart) - nameStart);
+        medians[name] = std::atof(line.c_str() + medianPos + 13);
+    }
+    return medians;
+}
+
+void writeResults(const std::string &path, const std::vector<BenchmarkResult> &results)
+{
+    std::ofstream out(path);
+    if (!out)
+    {
+        throw std::runtime_error("Could not write results " + path);
+    }
+    out << "{\"benchmarks\": [\n";
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const BenchmarkResult &result = results[i];
+        out << "{\"name\": \"" << result.name << "\", \"iterations\": " << result.iterations << ", \"median_ms\": " << result.medianMs
+            << ", \"min_ms\": " << result.minMs << ", \"counters\": {";
+        bool first = true;
+        for (const auto &counter : result.counters)
+        {
+            out << (first ? "" : ", ") << "\"" << counter.first << "\": " << counter.second;
+            first = false;
+        }
+        out << "}}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "]}\n";
+}
+
+Options parseOptions(int argc, char **argv)
+{
+    Options options;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        const std::string flag = argv[i];
+        if (flag == "--out")
+            options.outputPath = argv[i + 1];
+        else if (flag == "--baseline")
+            options.baselinePath = argv[i + 1];
+        else if (flag == "--tolerance")
+            options.tolerance = std::atof(argv[i + 1]);
+        else if (flag == "--filter")
+            options.filter = argv[i + 1];
+        else
+            throw std::invalid_argument("Unknown option " + flag);
+    }
+    return options;
+}
+}
+
+int main(int argc, char **argv)
+{
+    const Options options = parseOptions(argc, argv);
+    // The benchmark times the stages itself, recording spans for thousands of runs would only add noise
+    Profiler::instance().setEnabled(false);
+
+    std::vector<BenchmarkResult> results;
+    auto run = [&](const std::string &name, const std::function<void(std::map<std::string, double> &)> &fn)
+    {
+        if (!options.filter.empty() && name.find(options.filter) == std::string::npos)
+            return;
+        results.push_back(runCase(name, fn));
+        std::cout << name << "\t" << results.back().medianMs << " ms (min " << results.back().minMs << ", " << results.back().iterations << " runs)" << std::endl;
+    };
+    // Counter a case must report regardless of its timing, e.g. that a failure path was taken; a mismatch fails the run.
+    // Cases skipped by --filter are not checked.
+    int failedChecks = 0;
+    auto expect = [&](const std::string &name, const std::string &counter, double expected)
+    {
+        auto result = std::find_if(results.begin(), results.end(), [&](const BenchmarkResult &r) { return r.name == name; });
+        if (result == results.end())
+            return;
+        auto value = result->counters.find(counter);
+        if (value == result->counters.end() || value->second != expected)
+        {
+            std::cout << name << "\tCHECK FAILED: expected " << counter << " = " << expected << ", got "
+                      << (value == result->counters.end() ? std::string("nothing") : std::to_string(value->second)) << std::endl;
+            ++failedChecks;
+        }
+    };
+
+    const cv::Size resolutions[] = {{640, 480}, {1280, 720}, {1920, 1080}};
+    const FeatureDetectorMethod methods[] = {FeatureDetectorMethod::SIFT, FeatureDetectorMethod::ORB};
+
+    for (cv::Size size : resolutions)
+    {
+        const SyntheticPair pair = syntheticPair(size, 7);
+        for (FeatureDetectorMethod method : methods)
+        {
+            run("extract_features/" + methodName(method) + "/" + sizeName(size), [&](std::map<std::string, double> &counters)
+            {
+                ImageFeatures features = extract_features(pair.image1, method);
+                counters["keypoints"] = static_cast<double>(features.keypoints.size());
+            });
+
+            ExtractionOptions tiled;
+            tiled.tiled = true;
+            run("extract_features_tiled/" + methodName(method) + "/" + sizeName(size), [&](std::map<std::string, double> &counters)
+            {
+                ImageFeatures features = extract_features(pair.image1, method, tiled);
+                counters["keypoints"] = static_cast<double>(features.keypoints.size());
+            });
+        }
+    }
+
+    for (FeatureDetectorMethod method : methods)
+    {
+        for (int count : {1000, 5000, 20000})
+        {
+            ImageFeatures reference, query;
+            syntheticDescriptors(method, count, 11, reference, query);
+            run("match_features/" + methodName(method) + "/" + std::to_string(count), [&](std::map<std::string, double> &counters)
+            {
+                FeatureMatches matches = match_features(query, reference);
+                int correct = 0;
+                for (const auto &match : matches.matches)
+                {
+                    correct += match.queryIdx == match.trainIdx ? 1 : 0;
+                }
+                counters["correct_ratio"] = static_cast<double>(correct) / count;
+            });
+
+            const FeatureSet referenceSet = to_feature_set(reference, method);
+            const FeatureSet querySet = to_feature_set(query, method);
+            run("match_feature_sets/" + methodName(method) + "/" + std::to_string(count), [&](std::map<std::string, double> &counters)
+            {
+                MatchSet matches = match_feature_sets(querySet, referenceSet);
+                int correct = 0;
+                for (const auto &pair : matches.pairs)
+                {
+                    correct += pair.query == pair.train ? 1 : 0;
+                }
+                counters["correct_ratio"] = static_cast<double>(correct) / count;
+            });
+        }
+    }
+
+    for (double outlierRatio : {0.1, 0.3, 0.5})
+    {
+        std::vector<cv::KeyPoint> keypoints1, keypoints2;
+        FeatureMatches matches;
+        syntheticCorrespondences(2000, outlierRatio, 13, keypoints1, keypoints2, matches);
+        const FeatureSet features1 = to_feature_set(ImageFeatures{keypoints1}, FeatureDetectorMethod::SIFT);
+        const FeatureSet features2 = to_feature_set(ImageFeatures{keypoints2}, FeatureDetectorMethod::SIFT);
+        const MatchSet matchSet = to_match_set(matches);
+        for (float threshold : {1.0f, 5.0f})
+        {
+            const std::string name = "estimateHomography/outliers_" + std::to_string(static_cast<int>(outlierRatio * 100)) +
+                                     "/threshold_" + std::to_string(static_cast<int>(threshold));
+            run(name, [&](std::map<std::string, double> &counters)
+            {
+                HomographyEstimation estimation = estimateHomography(keypoints1, keypoints2, matches, threshold);
+                counters["inlier_ratio"] = static_cast<double>(estimation.numInliers) / matches.matches.size();
+            });
+
+            run("estimateHomography_soa" + name.substr(name.find('/')), [&](std::map<std::string, double> &counters)
+            {
+                HomographyEstimation estimation = estimateHomography(features1, features2, matchSet, threshold);
+                counters["inlier_ratio"] = static_cast<double>(estimation.numInliers) / matchSet.pairs.size();
+            });
+        }
+    }
+
+    // Whole pair homography from the images: full-resolution extract + match + estimate against the coarse-to-fine pass
+    for (cv::Size size : resolutions)
+    {
+        const SyntheticPair pair = syntheticPair(size, 7);
+        run("pair_homography/full/" + sizeName(size), [&](std::map<std::string, double> &counters)
+        {
+            const FeatureSet features1 = extract_feature_set(pair.image1);
+            const FeatureSet features2 = extract_feature_set(pair.image2);
+            const MatchSet matches = match_feature_sets(features2, features1);
+            HomographyEstimation estimation = estimateHomography(features2, features1, matches, 5.0f);
+            counters["corner_error_px"] = cornerError(estimation.H, pair.homography, size);
+        });
+        run("pair_homography/coarse_to_fine/" + sizeName(size), [&](std::map<std::string, double> &counters)
+        {
+            HomographyEstimation estimation = estimateHomographyCoarseToFine(pair.image1, pair.image2);
+            counters["corner_error_px"] = cornerError(estimation.H, pair.homography, size);
+        });
+
+        // Global matching against matching guided by a prior that is a few pixels off, as a previous frame's would be
+        const FeatureSet features1 = extract_feature_set(pair.image1);
+        const FeatureSet features2 = extract_feature_set(pair.image2);
+        const cv::Matx33d truth = pair.homography;
+        const cv::Matx33d prior = cv::Matx33d(1, 0, 4, 0, 1, -3, 0, 0, 1) * truth;
+        auto countInliers = [&](const MatchSet &matches)
+        {
+            int inliers = 0;
+            for (const auto &match : matches.pairs)
+            {
+                const cv::Vec3d p = truth * cv::Vec3d(features2.x[match.query], features2.y[match.query], 1.0);
+                const double dx = p[0] / p[2] - features1.x[match.train], dy = p[1] / p[2] - features1.y[match.train];
+                inliers += dx * dx + dy * dy < 25.0 ? 1 : 0;
+            }
+            return static_cast<double>(inliers);
+        };
+        run("pair_matching/global/" + sizeName(size), [&](std::map<std::string, double> &counters)
+        {
+            const MatchSet matches = match_feature_sets(features2, features1);
+            counters["matches"] = static_cast<double>(matches.pairs.size());
+            counters["true_matches"] = countInliers(matches);
+        });
+        run("pair_matching/guided/" + sizeName(size), [&](std::map<std::string, double> &counters)
+        {
+            const MatchSet matches = match_feature_sets_guided(features2, features1, prior);
+            counters["matches"] = static_cast<double>(matches.pairs.size());
+            counters["true_matches"] = countInliers(matches);
+        });
+    }
+
+    // Coarse-to-fine against a featureless image: no coarse estimate, so an empty H instead of an exception
+    {
+        const SyntheticPair pair = syntheticPair(cv::Size(1280, 720), 7);
+        const cv::Mat blank(pair.image2.size(), CV_8UC3, cv::Scalar(128, 128, 128));
+        run("pair_homography/coarse_to_fine/featureless", [&](std::map<std::string, double> &counters)
+        {
+            HomographyEstimation estimation = estimateHomographyCoarseToFine(pair.image1, blank);
+            counters["h_empty"] = estimation.H.empty();
+        });
+        expect("pair_homography/coarse_to_fine/featureless", "h_empty", 1.0);
+    }
+
+    // Joint refinement of drifting mosaic transforms; the drift counter is how far the last image's corners still are off
+    for (int count : {10, 40})
+    {
+        std::vector<cv::Mat> truth, initial;
+        std::vector<PairCorrespondences> pairs;
+        syntheticMosaic(count, 17, truth, initial, pairs);
+        run("bundle_adjustment/" + std::to_string(count), [&](std::map<std::string, double> &counters)
+        {
+            BundleAdjustmentResult adjustment = bundleAdjustHomographies(initial, pairs);
+            counters["initial_rms_px"] = adjustment.initialRmsError;
+            counters["final_rms_px"] = adjustment.finalRmsError;
+            counters["iterations"] = static_cast<double>(adjustment.iterations.size());
+            counters["initial_drift_px"] = cornerError(initial.back(), truth.back(), cv::Size(1280, 720));
+            counters["drift_px"] = cornerError(adjustment.transforms.back(), truth.back(), cv::Size(1280, 720));
+        });
+    }
+
+    const std::pair<StitchingMethod, std::string> stitchingMethods[] = {
+        {StitchingMethod::OVERLAY, "OVERLAY"}, {StitchingMethod::FEATHERING, "FEATHERING"}, {StitchingMethod::MULTIBAND, "MULTIBAND"}};
+    for (cv::Size size : resolutions)
+    {
+        const SyntheticPair pair = syntheticPair(size, 7);
+        for (const auto &method : stitchingMethods)
+        {
+            run("stitchImages/" + method.second + "/" + sizeName(size), [&](std::map<std::string, double> &counters)
+            {
+                StitchingTimings timings;
+                cv::Mat stitched = stitchImages(pair.image1, pair.image2, pair.homography, method.first, &timings);
+                counters["warp_ms"] = timings.warpTimeMs;
+                counters["blend_ms"] = timings.overlapTimeMs + timings.blendTimeMs;
+            });
+
+            // Same stitch into the buffers of a reused context, counting the cv::Mat allocations left per run.
+            // Tracking is only switched on here so the other cases keep the plain allocator.
+            PipelineContext context;
+            Profiler::instance().trackMatAllocations(true);
+            run("stitchImages_context/" + method.second + "/" + sizeName(size), [&](std::map<std::string, double> &counters)
+            {
+                const std::uint64_t before = Profiler::instance().allocationStats().allocations;
+                cv::Mat stitched = stitchImages(pair.image1, pair.image2, pair.homography, method.first, nullptr, &context);
+                counters["mat_allocations"] = static_cast<double>(Profiler::instance().allocationStats().allocations - before);
+            });
+            Profiler::instance().trackMatAllocations(false);
+        }
+    }
+
+    // Whole pairs through a reused context. With STITCHING_COUNT_HEAP_ALLOCATIONS every operator new is counted,
+    // not only cv::Mat buffers.
+    // The featureless pair has no matches, so estimation must return an empty H and stitching must be skipped.
+    {
+        const SyntheticPair pair = syntheticPair(cv::Size(1280, 720), 7);
+        const cv::Mat blank(pair.image1.size(), CV_8UC3, cv::Scalar(128, 128, 128));
+        const std::pair<std::string, const cv::Mat *> inputs[] = {{"textured", &pair.image2}, {"featureless", &blank}};
+        for (const auto &input : inputs)
+        {
+            PipelineContext context;
+            Profiler::instance().trackHeapAllocations(true);
+            run("stitchPair/" + input.first, [&](std::map<std::string, double> &counters)
+            {
+                PairResult result = stitchPair(context, pair.image1, *input.second);
+                counters["inliers"] = result.homography.numInliers;
+                counters["panorama_empty"] = result.panorama.empty();
+                if (Profiler::instance().heapTrackingAvailable())
+                    counters["heap_allocations"] = static_cast<double>(context.stats.lastPairHeapAllocations);
+            });
+            Profiler::instance().trackHeapAllocations(false);
+        }
+        expect("stitchPair/textured", "panorama_empty", 0.0);
+        expect("stitchPair/featureless", "panorama_empty", 1.0);
+    }
+
+    // Streams with featureless frames: the first one has nothing to estimate from, the middle one loses every
+    // track; both must keep the previous homography (or none) instead of ending the stream
+    {
+        const SyntheticPair pair = syntheticPair(cv::Size(640, 480), 7);
+        const std::filesystem::path directory = std::filesystem::temp_directory_path();
+        const std::string path1 = (directory / "stitching_benchmark_left.avi").string();
+        const std::string path2 = (directory / "stitching_benchmark_right.avi").string();
+        writeSyntheticVideo(path1, pair.image1, 12, {0, 6});
+        writeSyntheticVideo(path2, pair.image2, 12, {0, 6});
+        run("video/featureless_frames", [&](std::map<std::string, double> &counters)
+        {
+            StreamingStats stats = stitchVideoFiles(path1, path2, "");
+            counters["frames"] = stats.numFrames;
+            counters["redetections"] = stats.numRedetections;
+        });
+        expect("video/featureless_frames", "frames", 12.0);
+        std::filesystem::remove(path1);
+        std::filesystem::remove(path2);
+    }
+
+    writeResults(options.outputPath, results);
+    std::cout << "results written to " << options.outputPath << std::endl;
+
+    if (failedChecks > 0)
+        std::cout << failedChecks << " check(s) failed" << std::endl;
+    if (options.baselinePath.empty())
+        return failedChecks > 0 ? 1 : 0;
+
+    const std::map<std::string, double> baseline = readBaseline(options.baselinePath);
+    int regressions = 0;
+    std::cout << "case\tbaseline ms\tcurrent ms\tchange" << std::endl;
+    for (const auto &result : results)
+    {
+        auto previous = baseline.find(result.name);
+        if (previous == baseline.end() || previous->second <= 0.0)
+        {
+            std::cout << result.name << "\t-\t" << result.medianMs << "\tnew" << std::endl;
+            continue;
+        }
+        const double change = result.medianMs / previous->second - 1.0;
+        const bool regressed = change > options.tolerance;
+        regressions += regressed ? 1 : 0;
+        std::cout << result.name << "\t" << previous->second << "\t" << result.medianMs << "\t" << (change >= 0 ? "+" : "") << change * 100.0 << "%"
+                  << (regressed ? "\tREGRESSION" : "") << std::endl;
+    }
+    std::cout << regressions << " regression(s) beyond " << options.tolerance * 100.0 << "%" << std::endl;
+    return regressions > 0 || failedChecks > 0 ? 1 : 0;
+}
@@ -0,0 +1,406 @@
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <numeric>
+#include <stdexcept>
+#include <bundleAdjustment.h>
+#include <profiler.h>
+
+namespace
+{
+// A homography with H(2, 2) fixed to 1 has 8 free parameters
+const int PARAMS = 8;
+// Damping beyond which no step will lower the cost any more
+const double MAX_LAMBDA = 1e16;
+
+typedef cv::Vec<double, PARAMS> Homography;
+typedef cv::Vec<double, PARAMS> BlockVector;
+typedef cv::Matx<double, PARAMS, PARAMS> Block;
+
+Homography toParameters(const cv::Matx33d &H)
+{
+    if (std::abs(H(2, 2)) < 1e-12)
+    {
+        throw std::invalid_argument("Transforms with H(2, 2) = 0 cannot be adjusted");
+    }
+    Homography h;
+    for (int k = 0; k < PARAMS; ++k)
+    {
+        h[k] = H(k / 3, k % 3) / H(2, 2);
+    }
+    return h;
+}
+
+cv::Matx33d toMatrix(const Homography &h)
+{
+    return cv::Matx33d(h[0], h[1], h[2], h[3], h[4], h[5], h[6], h[7], 1.0);
+}
+
+// p mapped by h; with jx and jy, also the derivatives of the mapped x and y with respect to the parameters
+cv::Vec2d project(const Homography &h, const cv::Vec2d &p, BlockVector *jx = nullptr, BlockVector *jy = nullptr)
+{
+    const double x = p[0], y = p[1];
+    const double iw = 1.0 / (h[6] * x + h[7] * y + 1.0);
+    const double fx = (h[0] * x + h[1] * y + h[2]) * iw;
+    const double fy = (h[3] * x + h[4] * y + h[5]) * iw;
+    if (jx)
+    {
+        *jx = BlockVector(x * iw, y * iw, iw, 0.0, 0.0, 0.0, -x * fx * iw, -y * fx * iw);
+        *jy = BlockVector(0.0, 0.0, 0.0, x * iw, y * iw, iw, -x * fy * iw, -y * fy * iw);
+    }
+    return cv::Vec2d(fx, fy);
+}
+
+struct Edge
+{
+    int image1, image2;
+    std::vector<cv::Vec2d> points1, points2;
+};
+
+// Everything one pair adds to the normal equations. Its residuals only depend on its two images,
+// so it touches two diagonal blocks of J^T J and the one block coupling them.
+struct EdgeSystem
+{
+    Block block11, block22, block12;
+    BlockVector gradient1, gradient2;
+    double cost = 0.0;
+};
+
+// Residual r = H1 p1 - H2 p2 for each correspondence, J1 = dr/dh1 and J2 = dr/dh2
+void linearize(const Edge &edge, const Homography &h1, const Homography &h2, EdgeSystem &system)
+{
+    system = EdgeSystem();
+    BlockVector jx1, jy1, jx2, jy2;
+    for (size_t k = 0; k < edge.points1.size(); ++k)
+    {
+        const cv::Vec2d r = project(h1, edge.points1[k], &jx1, &jy1) - project(h2, edge.points2[k], &jx2, &jy2);
+        system.cost += r.dot(r);
+        system.block11 += jx1 * jx1.t() + jy1 * jy1.t();
+        system.block22 += jx2 * jx2.t() + jy2 * jy2.t();
+        system.block12 -= jx1 * jx2.t() + jy1 * jy2.t();
+        system.gradient1 += jx1 * r[0] + jy1 * r[1];
+        system.gradient2 -= jx2 * r[0] + jy2 * r[1];
+    }
+}
+
+// Lower triangle of a symmetric matrix, each row stored from its first nonzero column. Cholesky creates no
+// fill-in left of that column, so the factor fits in the same storage.
+class EnvelopeMatrix
+{
+public:
+    explicit EnvelopeMatrix(const std::vector<int> &first) : first(first), offsets(first.size() + 1, 0)
+    {
+        for (size_t r = 0; r < first.size(); ++r)
+        {
+            offsets[r + 1] = offsets[r] + (r - first[r] + 1);
+        }
+        values.assign(offsets.back(), 0.0);
+    }
+
+    int size() const { return static_cast<int>(first.size()); }
+    // Only for first[r] <= c <= r
+    double &at(int r, int c) { return values[offsets[r] + c - first[r]]; }
+    double at(int r, int c) const { return values[offsets[r] + c - first[r]]; }
+
+    // Adds a block of the lower triangle; diagonal blocks only contribute their lower half
+    void addBlock(int blockRow, int blockCol, const Block &block)
+    {
+        for (int r = 0; r < PARAMS; ++r)
+        {
+            const int row = blockRow * PARAMS + r;
+            for (int c = 0; c < PARAMS; ++c)
+            {
+                const int col = blockCol * PARAMS + c;
+                if (col <= row)
+                    at(row, col) += block(r, c);
+            }
+        }
+    }
+
+    // In place L L^T = A, false when A is not positive definite
+    bool factor()
+    {
+        for (int i = 0; i < size(); ++i)
+        {
+            for (int j = first[i]; j <= i; ++j)
+            {
+                const int k0 = std::max(first[i], first[j]);
+                const double *li = &at(i, k0), *lj = &at(j, k0);
+                double s = at(i, j);
+                for (int k = 0; k < j - k0; ++k)
+                {
+                    s -= li[k] * lj[k];
+                }
+                if (i == j)
+                {
+                    if (!(s > 0.0) || !std::isfinite(s))
+                        return false;
+                    at(i, i) = std::sqrt(s);
+                }
+                else
+                {
+                    at(i, j) = s / at(j, j);
+                }
+            }
+        }
+        return true;
+    }
+
+    // Solves L L^T x = b in place after factor()
+    void solve(std::vector<double> &b) const
+    {
+        for (int i = 0; i < size(); ++i)
+        {
+            double s = b[i];
+            for (int k = first[i]; k < i; ++k)
+            {
+                s -= at(i, k) * b[k];
+            }
+            b[i] = s / at(i, i);
+        }
+        for (int i = size() - 1; i >= 0; --i)
+        {
+            b[i] /= at(i, i);
+            for (int k = first[i]; k < i; ++k)
+            {
+                b[k] -= at(i, k) * b[i];
+            }
+        }
+    }
+
+    std::vector<int> first;
+    std::vector<size_t> offsets;
+    std::vector<double> values;
+};
+}
+
+BundleAdjustmentResult bundleAdjustHomographies(const std::vector<cv::Mat> &initialTransforms, const std::vector<PairCorrespondences> &pairs,
+                                                const BundleAdjustmentOptions &options)
+{
+    ScopedTimer timer("bundleAdjustHomographies", "alignment");
+    auto start = std::chrono::high_resolution_clock::now();
+    const int n = static_cast<int>(initialTransforms.size());
+    if (options.referenceImage < 0 || options.referenceImage >= n)
+    {
+        throw std::invalid_argument("Reference image out of range");
+    }
+    for (const auto &pair : pairs)
+    {
+        if (pair.image1 < 0 || pair.image1 >= n || pair.image2 < 0 || pair.image2 >= n || pair.image1 == pair.image2)
+        {
+            throw std::invalid_argument("Pair of images " + std::to_string(pair.image1) + " and " + std::to_string(pair.image2) + " is invalid");
+        }
+        if (pair.points1.size() != pair.points2.size())
+        {
+            throw std::invalid_argument("Pair correspondences have different numbers of points");
+        }
+    }
+
+    // One Hartley normalization shared by all images, so the 8 parameters are of comparable magnitude
+    cv::Vec2d mean(0.0, 0.0);
+    int numPoints = 0;
+    for (const auto &pair : pairs)
+    {
+        for (size_t k = 0; k < pair.points1.size(); ++k)
+        {
+            mean += cv::Vec2d(pair.points1[k].x, pair.points1[k].y) + cv::Vec2d(pair.points2[k].x, pair.points2[k].y);
+        }
+        numPoints += 2 * static_cast<int>(pair.points1.size());
+    }
+    double scale = 1.0;
+    if (numPoints > 0)
+    {
+        mean /= numPoints;
+        double meanDistance = 0.0;
+        for (const auto &pair : pairs)
+        {
+            for (size_t k = 0; k < pair.points1.size(); ++k)
+            {
+                meanDistance += cv::norm(cv::Vec2d(pair.points1[k].x, pair.points1[k].y) - mean) + cv::norm(cv::Vec2d(pair.points2[k].x, pair.points2[k].y) - mean);
+            }
+        }
+        meanDistance /= numPoints;
+        if (meanDistance > 0.0)
+            scale = std::sqrt(2.0) / meanDistance;
+    }
+    const cv::Matx33d T(scale, 0.0, -scale * mean[0], 0.0, scale, -scale * mean[1], 0.0, 0.0, 1.0);
+    const cv::Matx33d Tinv = T.inv();
+
+    std::vector<Homography> parameters(n);
+    for (int i = 0; i < n; ++i)
+    {
+        cv::Mat H;
+        initialTransforms[i].convertTo(H, CV_64F);
+        if (H.rows != 3 || H.cols != 3)
+        {
+            throw std::invalid_argument("Transforms must be 3x3");
+        }
+        parameters[i] = toParameters(T * cv::Matx33d(H) * Tinv);
+    }
+
+    std::vector<Edge> edges;
+    BundleAdjustmentResult result;
+    for (const auto &pair : pairs)
+    {
+        if (pair.points1.empty())
+            continue;
+        Edge edge{pair.image1, pair.image2, {}, {}};
+        for (size_t k = 0; k < pair.points1.size(); ++k)
+        {
+            edge.points1.emplace_back(scale * (pair.points1[k].x - mean[0]), scale * (pair.points1[k].y - mean[1]));
+            edge.points2.emplace_back(scale * (pair.points2[k].x - mean[0]), scale * (pair.points2[k].y - mean[1]));
+        }
+        result.numCorrespondences += static_cast<int>(pair.points1.size());
+        edges.push_back(std::move(edge));
+    }
+
+    // Unknowns are the parameters of every image but the reference
+    std::vector<int> variable(n, -1);
+    int numVariables = 0;
+    for (int i = 0; i < n; ++i)
+    {
+        if (i != options.referenceImage)
+            variable[i] = numVariables++;
+    }
+    const int N = PARAMS * numVariables;
+
+    // Block row v of J^T J starts at the lowest-numbered image sharing a pair with image v
+    std::vector<int> firstBlock(numVariables);
+    std::iota(firstBlock.begin(), firstBlock.end(), 0);
+    for (const auto &edge : edges)
+    {
+        const int a = variable[edge.image1], b = variable[edge.image2];
+        if (a >= 0 && b >= 0)
+            firstBlock[std::max(a, b)] = std::min(firstBlock[std::max(a, b)], std::min(a, b));
+    }
+    std::vector<int> first(N);
+    for (int r = 0; r < N; ++r)
+    {
+        first[r] = PARAMS * firstBlock[r / PARAMS];
+    }
+    EnvelopeMatrix normal(first), damped(first);
+
+    // Pairs are linearized in parallel, each into its own slot, and summed in a fixed order afterwards
+    std::vector<EdgeSystem> systems(edges.size());
+    auto evaluate = [&](const std::vector<Homography> &h)
+    {
+        cv::parallel_for_(cv::Range(0, static_cast<int>(edges.size())), [&](const cv::Range &range)
+        {
+            for (int e = range.start; e < range.end; ++e)
+            {
+                linearize(edges[e], h[edges[e].image1], h[edges[e].image2], systems[e]);
+            }
+        });
+        double cost = 0.0;
+        for (const auto &system : systems)
+        {
+            cost += system.cost;
+        }
+        return cost;
+    };
+    auto rmsError = [&](double cost)
+    {
+        return result.numCorrespondences > 0 ? std::sqrt(cost / result.numCorrespondences) / scale : 0.0;
+    };
+
+    double cost = evaluate(parameters);
+    result.initialRmsError = rmsError(cost);
+    double lambda = options.initialLambda;
+    std::vector<double> gradient(N), step(N);
+    std::vector<Homography> candidate;
+    for (int iteration = 0; iteration < options.maxIterations && N > 0 && cost > 0.0; ++iteration)
+    {
+        auto iterationStart = std::chrono::high_resolution_clock::now();
+        std::fill(normal.values.begin(), normal.values.end(), 0.0);
+        std::fill(gradient.begin(), gradient.end(), 0.0);
+        for (size_t e = 0; e < edges.size(); ++e)
+        {
+            const int a = variable[edges[e].image1], b = variable[edges[e].image2];
+            const EdgeSystem &system = systems[e];
+            if (a >= 0)
+            {
+                normal.addBlock(a, a, system.block11);
+                for (int k = 0; k < PARAMS; ++k)
+                    gradient[PARAMS * a + k] += system.gradient1[k];
+            }
+            if (b >= 0)
+            {
+                normal.addBlock(b, b, system.block22);
+                for (int k = 0; k < PARAMS; ++k)
+                    gradient[PARAMS * b + k] += system.gradient2[k];
+            }
+            if (a >= 0 && b >= 0)
+            {
+                if (a > b)
+                    normal.addBlock(a, b, system.block12);
+                else
+                    normal.addBlock(b, a, system.block12.t());
+            }
+        }
+
+        // Marquardt damping: grow lambda until a step lowers the cost
+        BundleAdjustmentIteration record{0.0, lambda, 0, 0.0};
+        double newCost = cost;
+        bool accepted = false;
+        while (!accepted && lambda < MAX_LAMBDA)
+        {
+            damped.values = normal.values;
+            for (int r = 0; r < N; ++r)
+            {
+                damped.at(r, r) += lambda * std::max(normal.at(r, r), 1e-12);
+            }
+            if (damped.factor())
+            {
+                for (int r = 0; r < N; ++r)
+                {
+                    step[r] = -gradient[r];
+                }
+                damped.solve(step);
+                candidate = parameters;
+                for (int i = 0; i < n; ++i)
+                {
+                    if (variable[i] < 0)
+                        continue;
+                    for (int k = 0; k < PARAMS; ++k)
+                        candidate[i][k] += step[PARAMS * variable[i] + k];
+                }
+                // Also linearizes at the candidate, which is where the next iteration starts if it is accepted
+                newCost = evaluate(candidate);
+                accepted = std::isfinite(newCost) && newCost < cost;
+            }
+            if (!accepted)
+            {
+                lambda *= 10.0;
+                ++record.rejectedSteps;
+            }
+        }
+        if (!accepted)
+            break;
+
+        const double decrease = (cost - newCost) / cost;
+        parameters.swap(candidate);
+        cost = newCost;
+        record.lambda = lambda;
+        record.rmsError = rmsError(cost);
+        record.timeMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - iterationStart).count();
+        result.iterations.push_back(record);
+        lambda = std::max(lambda / 10.0, 1e-12);
+        if (decrease < options.functionTolerance)
+            break;
+    }
+
+    result.finalRmsError = rmsError(cost);
+    result.transforms.resize(n);
+    for (int i = 0; i < n; ++i)
+    {
+        const cv::Matx33d H = Tinv * toMatrix(parameters[i]) * T;
+        result.transforms[i] = cv::Mat(H * (1.0 / H(2, 2)), true);
+    }
+    result.totalTimeMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+    Profiler &profiler = Profiler::instance();
+    profiler.recordMetric("adjustment_iterations", static_cast<double>(result.iterations.size()));
+    profiler.recordMetric("adjustment_rms_px", result.finalRmsError);
+    return result;
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+// Inlier correspondences of one matched pair: points1[k] in image1 and points2[k] in image2 show the same scene point
+struct PairCorrespondences {
+    int image1;
+    int image2;
+    std::vector<cv::Point2f> points1, points2;
+};
+
+struct BundleAdjustmentOptions {
+    int maxIterations = 50;
+    // The transform of this image is held fixed and defines the mosaic's coordinates
+    int referenceImage = 0;
+    // Initial Levenberg-Marquardt damping, relative to the diagonal of J^T J
+    double initialLambda = 1e-3;
+    // Stop once an accepted step lowers the cost by less than this fraction
+    double functionTolerance = 1e-8;
+};
+
+struct BundleAdjustmentIteration {
+    // RMS distance in pixels between corresponding points mapped into the mosaic, after this iteration
+    double rmsError;
+    double lambda;
+    // Damped steps rejected before one lowered the cost
+    int rejectedSteps;
+    double timeMs;
+};
+
+struct BundleAdjustmentResult {
+    std::vector<cv::Mat> transforms;
+    double initialRmsError = 0.0;
+    double finalRmsError = 0.0;
+    int numCorrespondences = 0;
+    std::vector<BundleAdjustmentIteration> iterations;
+    double totalTimeMs = 0.0;
+};
+
+// Jointly refine the homographies mapping every image into the mosaic so that the correspondences of all pairs
+// agree, which removes the drift of chaining pairwise estimates. Sparse Levenberg-Marquardt over 8 parameters per
+// image: the normal equations are accumulated per pair in parallel, and since a pair only couples its two images,
+// J^T J is block-sparse and is factored in its block envelope, which stays narrow for sequential mosaics.
+BundleAdjustmentResult bundleAdjustHomographies(const std::vector<cv::Mat> &initialTransforms, const std::vector<PairCorrespondences> &pairs,
+                                                const BundleAdjustmentOptions &options = BundleAdjustmentOptions());
@@ -0,0 +1,120 @@
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <coarseToFine.h>
+#include <profiler.h>
+
+namespace
+{
+// Guided matches of the refinement pass, below which the coarse estimate is kept
+const int MIN_REFINEMENT_MATCHES = 8;
+
+cv::Mat downscale(const cv::Mat &image, int levels)
+{
+    cv::Mat scaled = image;
+    for (int i = 0; i < levels; ++i)
+    {
+        cv::Mat next;
+        cv::pyrDown(scaled, next);
+        scaled = next;
+    }
+    return scaled;
+}
+
+// Bounding box of source's corners mapped by H, grown by margin and clipped to target.
+// The whole target when a corner maps to or behind the horizon, where the box would be meaningless.
+cv::Rect projectedBox(const cv::Matx33d &H, cv::Size source, cv::Size target, int margin)
+{
+    const cv::Rect targetRect(0, 0, target.width, target.height);
+    const double limit = 1e6;
+    std::vector<cv::Point2f> corners;
+    for (const cv::Vec3d &corner : {cv::Vec3d(0, 0, 1), cv::Vec3d(source.width, 0, 1), cv::Vec3d(source.width, source.height, 1), cv::Vec3d(0, source.height, 1)})
+    {
+        const cv::Vec3d p = H * corner;
+        if (p[2] <= 1e-9)
+            return targetRect;
+        corners.emplace_back(static_cast<float>(std::max(-limit, std::min(limit, p[0] / p[2]))),
+                             static_cast<float>(std::max(-limit, std::min(limit, p[1] / p[2]))));
+    }
+    const cv::Rect box = cv::boundingRect(corners);
+    return cv::Rect(box.x - margin, box.y - margin, box.width + 2 * margin, box.height + 2 * margin) & targetRect;
+}
+
+// The strongest keypoints inside region, in full image coordinates
+FeatureSet extractInside(const cv::Mat &image, const cv::Rect &region, const CoarseToFineOptions &options)
+{
+    ExtractionOptions extraction;
+    extraction.maxKeypoints = options.refinementKeypoints;
+    FeatureSet features = extract_feature_set(image(region), options.method, extraction);
+    for (float &x : features.x)
+    {
+        x += static_cast<float>(region.x);
+    }
+    for (float &y : features.y)
+    {
+        y += static_cast<float>(region.y);
+    }
+    return features;
+}
+}
+
+HomographyEstimation estimateHomographyCoarseToFine(const cv::Mat &image1, const cv::Mat &image2, const CoarseToFineOptions &options)
+{
+    ScopedTimer timer("estimateHomographyCoarseToFine", "homography");
+    auto start = std::chrono::high_resolution_clock::now();
+    const int levels = std::max(0, options.levels);
+    const double scale = static_cast<double>(1 << levels);
+
+    // Coarse pass over the whole of both images
+    HomographyEstimation coarse;
+    {
+        ScopedTimer coarseTimer("coarse_pass", "homography");
+        const FeatureSet features1 = extract_feature_set(downscale(image1, levels), options.method);
+        const FeatureSet features2 = extract_feature_set(downscale(image2, levels), options.method);
+        const MatchSet matches = match_feature_sets(features2, features1);
+        coarse = estimateHomography(features2, features1, matches, static_cast<float>(options.threshold / scale));
+    }
+    // Nothing to refine: report the failure the way estimateHomography does, with an empty H
+    if (coarse.H.empty())
+    {
+        coarse.estimationTimeMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+        return coarse;
+    }
+
+    // pyrDown keeps the even samples, so coarse pixel p is full-resolution pixel p * scale
+    const cv::Matx33d S(scale, 0, 0, 0, scale, 0, 0, 0, 1);
+    const cv::Matx33d coarseH = coarse.H;
+    const cv::Matx33d predicted = S * coarseH * S.inv();
+
+    HomographyEstimation result;
+    result.H = cv::Mat(predicted, true);
+    result.numInliers = coarse.numInliers;
+    // The coarse residual is measured in coarse pixels; one coarse pixel spans scale full-resolution pixels
+    result.alignmentError = static_cast<float>(coarse.alignmentError * scale);
+    result.iterations = 0;
+    result.timePerIterationUs = 0.0f;
+
+    // Refinement: full-resolution features only where the prediction says the images overlap
+    const cv::Rect region1 = projectedBox(predicted, image2.size(), image1.size(), options.overlapMargin);
+    const cv::Rect region2 = projectedBox(predicted.inv(), image1.size(), image2.size(), options.overlapMargin);
+    if (!region1.empty() && !region2.empty())
+    {
+        ScopedTimer refineTimer("refinement_pass", "homography");
+        const FeatureSet features1 = extractInside(image1, region1, options);
+        const FeatureSet features2 = extractInside(image2, region2, options);
+        // Only candidates near where the prediction puts a keypoint are compared, the rest would be outliers anyway
+        GuidedMatchOptions guided;
+        guided.radius = options.predictionRadius;
+        const MatchSet matches = match_feature_sets_guided(features2, features1, predicted, guided);
+
+        // estimateHomography reports a degenerate refinement as an empty H, which keeps the scaled coarse estimate
+        if (static_cast<int>(matches.pairs.size()) >= MIN_REFINEMENT_MATCHES)
+        {
+            HomographyEstimation refined = estimateHomography(features2, features1, matches, options.threshold);
+            if (!refined.H.empty() && refined.numInliers >= MIN_REFINEMENT_MATCHES)
+                result = refined;
+        }
+    }
+
+    result.estimationTimeMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    return result;
+}
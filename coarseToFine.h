@@ -0,0 +1,26 @@
+#pragma once
+#include <opencv2/opencv.hpp>
+#include "featureDetection.h"
+#include "warping.h"
+
+struct CoarseToFineOptions {
+    FeatureDetectorMethod method = FeatureDetectorMethod::SIFT;
+    // The coarse pass runs on this pyramid level, at 1 / 2^levels of the full resolution
+    int levels = 2;
+    // Reprojection threshold in full-resolution pixels, scaled down for the coarse pass
+    float threshold = 5.0f;
+    // Strongest keypoints detected per image inside the predicted overlap at full resolution
+    int refinementKeypoints = 1000;
+    // Grows the predicted overlap, in full-resolution pixels, to absorb the error of the coarse estimate
+    int overlapMargin = 32;
+    // Full-resolution matches are only searched within this radius of where the coarse estimate puts them
+    float predictionRadius = 16.0f;
+};
+
+// Homography from image2 into image1, as estimateHomography(features2, features1, ...) returns it, found on a
+// downscaled pyramid level, scaled up and refined with a few features detected only inside the predicted overlap
+// at full resolution. Falls back to the scaled coarse estimate when the refinement finds too little support or
+// yields no homography, and returns an empty H with no inliers, like estimateHomography, when the coarse level yields no estimate.
+// Unlike estimateHomography, estimationTimeMs covers the whole pass including detection and matching, so it
+// compares directly against extract + match + estimate at full resolution.
+HomographyEstimation estimateHomographyCoarseToFine(const cv::Mat &image1, const cv::Mat &image2, const CoarseToFineOptions &options = CoarseToFineOptions());
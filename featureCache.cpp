@@ -0,0 +1,344 @@
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <featureCache.h>
+#include <profiler.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <process.h>
+#endif
+
+namespace fs = std::filesystem;
+
+std::string uniqueTemporaryPath(const std::string &path)
+{
+    static std::atomic<std::uint64_t> counter{0};
+#ifndef _WIN32
+    const long processId = static_cast<long>(getpid());
+#else
+    const long processId = static_cast<long>(_getpid());
+#endif
+    std::ostringstream name;
+    name << path << "." << processId << "." << std::hash<std::thread::id>()(std::this_thread::get_id()) << "." << counter++ << ".tmp";
+    return name.str();
+}
+
+namespace
+{
+const char CACHE_MAGIC[8] = {'V', 'C', 'F', 'E', 'A', 'T', 'S', '\0'};
+const std::uint32_t CACHE_VERSION = 1;
+
+struct CacheHeader
+{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t numKeypoints;
+    std::int32_t descriptorRows;
+    std::int32_t descriptorCols;
+    std::int32_t descriptorType;
+    std::uint32_t reserved;
+};
+
+struct KeypointRecord
+{
+    float x, y, size, angle, response;
+    std::int32_t octave, classId;
+};
+
+// Parameters extract_features passes to the detectors; bump these whenever that changes,
+// otherwise stale entries are served for the new configuration.
+std::string detectorKey(FeatureDetectorMethod method)
+{
+    switch (method)
+    {
+    case FeatureDetectorMethod::SIFT:
+        return "SIFT(nfeatures=0,nOctaveLayers=3,contrastThreshold=0.04,edgeThreshold=10,sigma=1.6)";
+    case FeatureDetectorMethod::ORB:
+        return "ORB(nfeatures=500,scaleFactor=1.2,nlevels=8,edgeThreshold=31,firstLevel=0,WTA_K=2,HARRIS,patchSize=31,fastThreshold=20)";
+    default:
+        throw std::invalid_argument("Unsupported feature detector method");
+    }
+}
+
+// Whole-image extraction has no suffix, so entries written before tiling existed stay valid
+std::string extractionKey(const ExtractionOptions &options)
+{
+    if (!options.tiled)
+        return options.maxKeypoints > 0 ? "|max=" + std::to_string(options.maxKeypoints) : "";
+    return "|tiled(size=" + std::to_string(options.tileSize) + ",overlap=" + std::to_string(options.tileOverlap) +
+           ",perTile=" + std::to_string(options.maxKeypointsPerTile) + ")";
+}
+
+std::uint64_t mix(std::uint64_t h, std::uint64_t v)
+{
+    h ^= v;
+    h *= 0x100000001b3ULL;
+    h ^= h >> 29;
+    return h;
+}
+
+std::uint64_t hash_bytes(const void *data, std::size_t size, std::uint64_t h)
+{
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    std::size_t i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+        std::uint64_t word;
+        std::memcpy(&word, bytes + i, 8);
+        h = mix(h, word);
+    }
+    for (; i < size; ++i)
+    {
+        h = mix(h, bytes[i]);
+    }
+    return h;
+}
+}
+
+std::uint64_t hash_image(const cv::Mat &image)
+{
+    std::uint64_t h = 0xcbf29ce484222325ULL;
+    h = mix(h, static_cast<std::uint64_t>(image.rows));
+    h = mix(h, static_cast<std::uint64_t>(image.cols));
+    h = mix(h, static_cast<std::uint64_t>(image.type()));
+    const std::size_t rowBytes = image.cols * image.elemSize();
+    for (int y = 0; y < image.rows; ++y)
+    {
+        h = hash_bytes(image.ptr(y), rowBytes, h);
+    }
+    return h;
+}
+
+FeatureCache::FeatureCache(const std::string &directory, std::uintmax_t maxBytes)
+    : directory(directory), maxBytes(maxBytes), sizeBytes(0), hits(0), misses(0), evictions(0)
+{
+    fs::create_directories(directory);
+    for (const auto &entry : fs::directory_iterator(directory))
+    {
+        if (entry.is_regular_file() && entry.path().extension() == ".feat")
+        {
+            sizeBytes += entry.file_size();
+        }
+    }
+}
+
+std::string FeatureCache::entryPath(const cv::Mat &image, FeatureDetectorMethod method, const ExtractionOptions &options) const
+{
+    std::string key = detectorKey(method) + extractionKey(options);
+    std::uint64_t h = hash_bytes(key.data(), key.size(), hash_image(image));
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.feat", static_cast<unsigned long long>(h));
+    return (fs::path(directory) / name).string();
+}
+
+static bool decodeEntry(const unsigned char *data, std::size_t size, ImageFeatures &features)
+{
+    if (size < sizeof(CacheHeader))
+        return false;
+    CacheHeader header;
+    std::memcpy(&header, data, sizeof(header));
+    if (std::memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 || header.version != CACHE_VERSION)
+        return false;
+
+    const std::size_t keypointBytes = header.numKeypoints * sizeof(KeypointRecord);
+    const std::size_t descriptorBytes = header.descriptorRows > 0
+        ? static_cast<std::size_t>(header.descriptorRows) * header.descriptorCols * CV_ELEM_SIZE(header.descriptorType)
+        : 0;
+    if (size != sizeof(CacheHeader) + keypointBytes + descriptorBytes)
+        return false;
+
+    const unsigned char *cursor = data + sizeof(CacheHeader);
+    features.keypoints.resize(header.numKeypoints);
+    for (std::uint32_t i = 0; i < header.numKeypoints; ++i)
+    {
+        KeypointRecord record;
+        std::memcpy(&record, cursor + i * sizeof(KeypointRecord), sizeof(record));
+        features.keypoints[i] = cv::KeyPoint(record.x, record.y, record.size, record.angle, record.response, record.octave, record.classId);
+    }
+    cursor += keypointBytes;
+
+    if (descriptorBytes > 0)
+    {
+        cv::Mat mapped(header.descriptorRows, header.descriptorCols, header.descriptorType, const_cast<unsigned char *>(cursor));
+        features.descriptors = mapped.clone();
+    }
+    else
+    {
+        features.descriptors = cv::Mat();
+    }
+    return true;
+}
+
+bool FeatureCache::load(const cv::Mat &image, FeatureDetectorMethod method, ImageFeatures &features, const ExtractionOptions &options)
+{
+    const std::string path = entryPath(image, method, options);
+    bool decoded = false;
+
+#ifndef _WIN32
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd >= 0)
+    {
+        struct stat st;
+        if (::fstat(fd, &st) == 0 && st.st_size > 0)
+        {
+            void *data = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data != MAP_FAILED)
+            {
+                decoded = decodeEntry(static_cast<const unsigned char *>(data), st.st_size, features);
+                ::munmap(data, st.st_size);
+            }
+        }
+        ::close(fd);
+    }
+#else
+    std::ifstream file(path, std::ios::binary);
+    if (file)
+    {
+        std::vector<unsigned char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        decoded = decodeEntry(data.data(), data.size(), features);
+    }
+#endif
+
+    if (!decoded)
+    {
+        ++misses;
+        return false;
+    }
+
+    // Refresh the timestamp so eviction sees this entry as recently used
+    std::error_code ec;
+    fs::last_write_time(path, fs::file_time_type::clock::now(), ec);
+    ++hits;
+    return true;
+}
+
+void FeatureCache::store(const cv::Mat &image, FeatureDetectorMethod method, const ImageFeatures &features, const ExtractionOptions &options)
+{
+    const std::string path = entryPath(image, method, options);
+    cv::Mat descriptors = features.descriptors.isContinuous() ? features.descriptors : features.descriptors.clone();
+
+    CacheHeader header;
+    std::memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    header.version = CACHE_VERSION;
+    header.numKeypoints = static_cast<std::uint32_t>(features.keypoints.size());
+    header.descriptorRows = descriptors.rows;
+    header.descriptorCols = descriptors.cols;
+    header.descriptorType = descriptors.type();
+    header.reserved = 0;
+
+    std::vector<KeypointRecord> records(features.keypoints.size());
+    for (std::size_t i = 0; i < features.keypoints.size(); ++i)
+    {
+        const cv::KeyPoint &kp = features.keypoints[i];
+        records[i] = {kp.pt.x, kp.pt.y, kp.size, kp.angle, kp.response, kp.octave, kp.class_id};
+    }
+
+    // Write to a temporary file and rename, so concurrent readers never map a partial entry. The temporary name is
+    // unique per process, thread and call, so concurrent writers of the same entry never interleave into one file.
+    const std::string tmpPath = uniqueTemporaryPath(path);
+    const std::uintmax_t entrySize = sizeof(header) + records.size() * sizeof(KeypointRecord) + descriptors.total() * descriptors.elemSize();
+    {
+        std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+        if (!file)
+        {
+            throw std::runtime_error("Could not write feature cache entry " + tmpPath);
+        }
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char *>(records.data()), records.size() * sizeof(KeypointRecord));
+        file.write(reinterpret_cast<const char *>(descriptors.data), descriptors.total() * descriptors.elemSize());
+        file.close();
+        if (!file)
+        {
+            std::error_code ec;
+            fs::remove(tmpPath, ec);
+            throw std::runtime_error("Could not write feature cache entry " + tmpPath);
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    std::error_code ec;
+    std::uintmax_t previousSize = fs::file_size(path, ec);
+    if (ec)
+        previousSize = 0;
+    fs::rename(tmpPath, path, ec);
+    if (ec)
+    {
+        fs::remove(tmpPath, ec);
+        throw std::runtime_error("Could not store feature cache entry " + path);
+    }
+    sizeBytes = sizeBytes - std::min(previousSize, sizeBytes) + entrySize;
+    evict();
+}
+
+// Remove least-recently-used entries until the cache fits into maxBytes; caller holds the mutex
+void FeatureCache::evict()
+{
+    if (sizeBytes <= maxBytes)
+        return;
+
+    std::vector<fs::directory_entry> entries;
+    for (const auto &entry : fs::directory_iterator(directory))
+    {
+        if (entry.is_regular_file() && entry.path().extension() == ".feat")
+        {
+            entries.push_back(entry);
+        }
+    }
+    std::sort(entries.begin(), entries.end(), [](const fs::directory_entry &a, const fs::directory_entry &b)
+              { return a.last_write_time() < b.last_write_time(); });
+
+    for (const auto &entry : entries)
+    {
+        if (sizeBytes <= maxBytes)
+            break;
+        std::error_code ec;
+        std::uintmax_t size = entry.file_size(ec);
+        if (!ec && fs::remove(entry.path(), ec))
+        {
+            sizeBytes -= std::min(size, sizeBytes);
+            ++evictions;
+        }
+    }
+}
+
+FeatureCacheStats FeatureCache::stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return {hits.load(), misses.load(), evictions.load(), sizeBytes};
+}
+
+ImageFeatures extract_features_cached(FeatureCache &cache, const cv::Mat &image, const FeatureDetectorMethod method, const ExtractionOptions &options)
+{
+    ImageFeatures features;
+    bool hit;
+    {
+        ScopedTimer timer("feature_cache_load", "io");
+        hit = cache.load(image, method, features, options);
+    }
+    if (hit)
+    {
+        if (options.drawKeypoints)
+        {
+            cv::drawKeypoints(image, features.keypoints, features.imageWithKeypoints);
+        }
+        // Recorded like a fresh extraction, so metrics do not depend on the cache state
+        Profiler::instance().addCounter("keypoints", static_cast<double>(features.keypoints.size()));
+        Profiler::instance().recordMetric("keypoints", static_cast<double>(features.keypoints.size()));
+        return features;
+    }
+
+    features = extract_features(image, method, options);
+    cache.store(image, method, features, options);
+    return features;
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <opencv2/opencv.hpp>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include "featureDetection.h"
+
+// path plus the process id, the calling thread and a per-process counter: a file that concurrent writers of path
+// never share, to be renamed over path once it is complete
+std::string uniqueTemporaryPath(const std::string &path);
+
+struct FeatureCacheStats {
+    std::size_t hits;
+    std::size_t misses;
+    std::size_t evictions;
+    std::uintmax_t sizeBytes;
+};
+
+// On-disk store of keypoints and descriptors keyed by image content, detector type and detector parameters.
+// Each entry is one flat binary file (header, keypoint records, raw descriptor rows) that is read back via mmap.
+// Entries are evicted least-recently-used first once the directory grows beyond maxBytes.
+class FeatureCache {
+public:
+    explicit FeatureCache(const std::string &directory, std::uintmax_t maxBytes = std::uintmax_t(1) << 30);
+
+    bool load(const cv::Mat &image, FeatureDetectorMethod method, ImageFeatures &features, const ExtractionOptions &options = ExtractionOptions());
+    void store(const cv::Mat &image, FeatureDetectorMethod method, const ImageFeatures &features, const ExtractionOptions &options = ExtractionOptions());
+    FeatureCacheStats stats() const;
+
+private:
+    std::string entryPath(const cv::Mat &image, FeatureDetectorMethod method, const ExtractionOptions &options) const;
+    void evict();
+
+    std::string directory;
+    std::uintmax_t maxBytes;
+    std::uintmax_t sizeBytes;
+    std::atomic<std::size_t> hits, misses, evictions;
+    mutable std::mutex mutex;
+};
+
+std::uint64_t hash_image(const cv::Mat &image);
+ImageFeatures extract_features_cached(FeatureCache &cache, const cv::Mat &image, const FeatureDetectorMethod method = FeatureDetectorMethod::SIFT,
+                                      const ExtractionOptions &options = ExtractionOptions());
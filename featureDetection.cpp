@@ -1,76 +1,756 @@
 #include <iostream>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <numeric>
 #include <opencv2/opencv.hpp>
 #include <matplot/matplot.h>
-
-enum class FeatureDetectorMethod {
-    SIFT,
-    ORB
-};
+#include <featureDetection.h>
+#include <hammingMatcher.h>
+#include <profiler.h>
+#include <pipelineContext.h>
 
 cv::Mat load_image(const std::string &path)
 {
+    ScopedTimer timer("load_image", "io");
     cv::Mat image = cv::imread(path);
     if (image.empty())
     {
         throw std::runtime_error("Could not open or find the image!");
     }
 
+    Profiler::instance().addCounter("images_loaded", 1);
+    Profiler::instance().addCounter("image_bytes_loaded", static_cast<double>(image.total() * image.elemSize()));
     return image;
 }
 
-struct ImageFeatures
+// maxKeypoints <= 0 keeps the detector's default: every SIFT keypoint, 500 for ORB
+static cv::Ptr<cv::Feature2D> createDetector(FeatureDetectorMethod method, int maxKeypoints = 0)
+{
+    switch (method)
+    {
+    case FeatureDetectorMethod::SIFT:
+        return cv::SIFT::create(std::max(0, maxKeypoints));
+    case FeatureDetectorMethod::ORB:
+        return cv::ORB::create(maxKeypoints > 0 ? maxKeypoints : 500);
+    default:
+        throw std::invalid_argument("Unsupported feature detector method");
+    }
+}
+
+// Keypoints whose position lies inside core, detected on core grown by the tile overlap so they see
+// the same neighbourhood as in the full image. Positions are returned in image coordinates.
+static void extractTile(const cv::Mat &image, const cv::Rect &core, FeatureDetectorMethod method, const ExtractionOptions &options,
+                        std::vector<cv::KeyPoint> &keypoints, cv::Mat &descriptors)
+{
+    const int overlap = std::max(0, options.tileOverlap);
+    const cv::Rect region = cv::Rect(core.x - overlap, core.y - overlap, core.width + 2 * overlap, core.height + 2 * overlap) &
+                            cv::Rect(0, 0, image.cols, image.rows);
+    const cv::Mat tile = image(region);
+    const cv::Point2f offset(static_cast<float>(region.x), static_cast<float>(region.y));
+    auto outsideCore = [&](const cv::KeyPoint &keypoint)
+    {
+        const cv::Point2f p = keypoint.pt + offset;
+        return p.x < core.x || p.y < core.y || p.x >= core.x + core.width || p.y >= core.y + core.height;
+    };
+
+    // ORB detects a fixed number of features, so every tile gets its share of the whole-image budget
+    int orbFeatures = options.maxKeypointsPerTile;
+    if (orbFeatures <= 0)
+        orbFeatures = static_cast<int>(std::ceil(500.0 * region.area() / image.total()));
+    cv::Ptr<cv::Feature2D> detector = createDetector(method, method == FeatureDetectorMethod::ORB ? orbFeatures : 0);
+
+    if (options.maxKeypointsPerTile <= 0)
+    {
+        std::vector<cv::KeyPoint> detected;
+        cv::Mat detectedDescriptors;
+        detector->detectAndCompute(tile, cv::noArray(), detected, detectedDescriptors);
+        for (size_t i = 0; i < detected.size(); ++i)
+        {
+            if (outsideCore(detected[i]))
+                continue;
+            keypoints.push_back(detected[i]);
+            descriptors.push_back(detectedDescriptors.row(static_cast<int>(i)));
+        }
+    }
+    else
+    {
+        // Budget before describing, so descriptors are only computed for the keypoints that are kept
+        detector->detect(tile, keypoints);
+        keypoints.erase(std::remove_if(keypoints.begin(), keypoints.end(), outsideCore), keypoints.end());
+        cv::KeyPointsFilter::retainBest(keypoints, options.maxKeypointsPerTile);
+        detector->compute(tile, keypoints, descriptors);
+    }
+
+    for (auto &keypoint : keypoints)
+    {
+        keypoint.pt += offset;
+    }
+}
+
+// The same corner can be found on both sides of a border between two tiles at slightly different
+// sub-pixel positions. Of such pairs only the one with the stronger response is kept.
+static void suppressBorderDuplicates(ImageFeatures &features, int tileSize, float radius)
 {
-    std::vector<cv::KeyPoint> keypoints;
+    auto tileOf = [&](const cv::KeyPoint &keypoint)
+    {
+        return cv::Point(static_cast<int>(keypoint.pt.x) / tileSize, static_cast<int>(keypoint.pt.y) / tileSize);
+    };
+    auto nearBorder = [&](float coordinate)
+    {
+        const float within = std::fmod(coordinate, static_cast<float>(tileSize));
+        return (within < radius && coordinate >= tileSize) || tileSize - within < radius;
+    };
+
+    std::vector<int> candidates;
+    for (int i = 0; i < static_cast<int>(features.keypoints.size()); ++i)
+    {
+        if (nearBorder(features.keypoints[i].pt.x) || nearBorder(features.keypoints[i].pt.y))
+            candidates.push_back(i);
+    }
+    std::sort(candidates.begin(), candidates.end(), [&](int a, int b) { return features.keypoints[a].response > features.keypoints[b].response; });
+
+    std::vector<bool> removed(features.keypoints.size(), false);
+    for (size_t a = 0; a < candidates.size(); ++a)
+    {
+        const cv::KeyPoint &kept = features.keypoints[candidates[a]];
+        if (removed[candidates[a]])
+            continue;
+        for (size_t b = a + 1; b < candidates.size(); ++b)
+        {
+            const cv::KeyPoint &other = features.keypoints[candidates[b]];
+            if (removed[candidates[b]] || tileOf(kept) == tileOf(other))
+                continue;
+            const bool sameScale = std::abs(kept.size - other.size) <= 0.25f * std::max(kept.size, other.size);
+            if (sameScale && cv::norm(kept.pt - other.pt) < radius)
+                removed[candidates[b]] = true;
+        }
+    }
+
+    size_t next = 0;
     cv::Mat descriptors;
-    cv::Mat imageWithKeypoints;
-};
+    for (size_t i = 0; i < features.keypoints.size(); ++i)
+    {
+        if (removed[i])
+            continue;
+        features.keypoints[next++] = features.keypoints[i];
+        descriptors.push_back(features.descriptors.row(static_cast<int>(i)));
+    }
+    features.keypoints.resize(next);
+    features.descriptors = descriptors;
+}
 
-struct FeatureMatches
+static ImageFeatures extractTiled(const cv::Mat &image, FeatureDetectorMethod method, const ExtractionOptions &options)
 {
-    std::vector<cv::DMatch> matches;
-    std::vector<float> distances;
-    double matchingTimeMs;
-};
+    if (options.tileSize <= 0)
+    {
+        throw std::invalid_argument("Tile size must be positive");
+    }
+    const int tilesX = (image.cols + options.tileSize - 1) / options.tileSize;
+    const int tilesY = (image.rows + options.tileSize - 1) / options.tileSize;
+    std::vector<std::vector<cv::KeyPoint>> tileKeypoints(tilesX * tilesY);
+    std::vector<cv::Mat> tileDescriptors(tilesX * tilesY);
+
+    cv::parallel_for_(cv::Range(0, tilesX * tilesY), [&](const cv::Range &range)
+    {
+        for (int index = range.start; index < range.end; ++index)
+        {
+            const cv::Rect core = cv::Rect((index % tilesX) * options.tileSize, (index / tilesX) * options.tileSize, options.tileSize, options.tileSize) &
+                                  cv::Rect(0, 0, image.cols, image.rows);
+            extractTile(image, core, method, options, tileKeypoints[index], tileDescriptors[index]);
+        }
+    });
 
-ImageFeatures extract_features(const cv::Mat &image, const FeatureDetectorMethod method = FeatureDetectorMethod::SIFT)
+    // Merged in tile order, so the result does not depend on scheduling
+    ImageFeatures features;
+    std::vector<cv::Mat> nonEmpty;
+    for (int index = 0; index < tilesX * tilesY; ++index)
+    {
+        features.keypoints.insert(features.keypoints.end(), tileKeypoints[index].begin(), tileKeypoints[index].end());
+        if (!tileDescriptors[index].empty())
+            nonEmpty.push_back(tileDescriptors[index]);
+    }
+    if (!nonEmpty.empty())
+        cv::vconcat(nonEmpty, features.descriptors);
+
+    suppressBorderDuplicates(features, options.tileSize, 2.0f);
+    return features;
+}
+
+ImageFeatures extract_features(const cv::Mat &image, const FeatureDetectorMethod method, const ExtractionOptions &options)
 {
+    ScopedTimer timer("extract_features", "features");
     ImageFeatures features;
-    switch(method){
-        case FeatureDetectorMethod::SIFT: {
-            cv::Ptr<cv::SIFT> sift = cv::SIFT::create();
-            sift->detectAndCompute(image, cv::noArray(), features.keypoints, features.descriptors);
-            break;
+    if (options.tiled)
+    {
+        features = extractTiled(image, method, options);
+    }
+    else
+    {
+        createDetector(method, options.maxKeypoints)->detectAndCompute(image, cv::noArray(), features.keypoints, features.descriptors);
+    }
+
+    if (options.drawKeypoints)
+    {
+        cv::drawKeypoints(image, features.keypoints, features.imageWithKeypoints);
+    }
+    Profiler::instance().addCounter("keypoints", static_cast<double>(features.keypoints.size()));
+    Profiler::instance().recordMetric("keypoints", static_cast<double>(features.keypoints.size()));
+    return features;
+}
+
+static MatcherBackend resolveBackend(MatcherBackend backend, const cv::Mat &descriptors)
+{
+    if (backend != MatcherBackend::AUTO)
+        return backend;
+    if (descriptors.depth() == CV_32F)
+        return MatcherBackend::FLANN_KDTREE;
+    if (descriptors.depth() == CV_8U)
+        return MatcherBackend::HAMMING;
+    return MatcherBackend::BRUTE_FORCE;
+}
+
+FeatureMatcher::FeatureMatcher(const MatchOptions &options)
+    : options(options)
+{
+}
+
+FeatureMatcher::FeatureMatcher(const cv::Mat &referenceDescriptors, const MatchOptions &options)
+{
+    train(referenceDescriptors, options);
+}
+
+void FeatureMatcher::train(const cv::Mat &descriptors, const MatchOptions &matchOptions)
+{
+    referenceDescriptors = descriptors;
+    options = matchOptions;
+    backend = resolveBackend(options.backend, descriptors);
+    buildTimeMs = 0.0;
+    if (descriptors.empty())
+        return;
+
+    // Build the index over the train descriptors. Every backend keeps its object from the previous reference,
+    // but a FLANN tree or hash table is a function of the data and has to be rebuilt.
+    auto buildStart = std::chrono::high_resolution_clock::now();
+    switch (backend)
+    {
+    case MatcherBackend::FLANN_KDTREE:
+        if (!index)
+            index = cv::makePtr<cv::flann::Index>();
+        index->build(descriptors, cv::flann::KDTreeIndexParams(4));
+        break;
+    case MatcherBackend::FLANN_LSH:
+        if (!index)
+            index = cv::makePtr<cv::flann::Index>();
+        index->build(descriptors, cv::flann::LshIndexParams(6, 12, 1), cvflann::FLANN_DIST_HAMMING);
+        break;
+    case MatcherBackend::HAMMING:
+        if (!hamming)
+            hamming = cv::makePtr<HammingMatcher>();
+        hamming->setTrainDescriptors(descriptors);
+        break;
+    case MatcherBackend::BRUTE_FORCE:
+        bruteForce = cv::makePtr<cv::BFMatcher>(descriptors.depth() == CV_8U ? cv::NORM_HAMMING : cv::NORM_L2);
+        bruteForce->add(std::vector<cv::Mat>{descriptors});
+        bruteForce->train();
+        break;
+    default:
+        throw std::invalid_argument("Unsupported matcher backend");
+    }
+    auto buildEnd = std::chrono::high_resolution_clock::now();
+    buildTimeMs = std::chrono::duration<double, std::milli>(buildEnd - buildStart).count();
+}
+
+FeatureMatcher::FeatureMatcher(const ImageFeatures &reference, const MatchOptions &options)
+    : FeatureMatcher(reference.descriptors, options)
+{
+}
+
+// Quantized SIFT rows go back to float: the KD-tree and the L2 backends only index CV_32F.
+// Sets that kept the detector's float rows are matched on those; otherwise the float copy is written to a view of storage.
+static cv::Mat matchableDescriptors(const FeatureSet &features, cv::Mat &storage)
+{
+    if (features.descriptorNorm != cv::NORM_L2 || features.descriptors.depth() == CV_32F)
+        return features.descriptors;
+    if (!features.floatDescriptors.empty())
+        return features.floatDescriptors;
+    cv::Mat descriptors = acquireBuffer(storage, features.descriptors.size(), CV_32F);
+    features.descriptors.convertTo(descriptors, CV_32F);
+    return descriptors;
+}
+
+static cv::Mat matchableDescriptors(const FeatureSet &features)
+{
+    cv::Mat storage;
+    return matchableDescriptors(features, storage);
+}
+
+FeatureMatcher::FeatureMatcher(const FeatureSet &reference, const MatchOptions &options)
+    : FeatureMatcher(matchableDescriptors(reference), options)
+{
+}
+
+void FeatureMatcher::knnSearch(const cv::Mat &queryDescriptors, int k, MatchScratch &scratch) const
+{
+    switch (backend)
+    {
+    case MatcherBackend::FLANN_KDTREE:
+    case MatcherBackend::FLANN_LSH:
+    {
+        // Checks of cv::flann::SearchParams(32), kept so the search does not rebuild its parameter map per call
+        static const cv::flann::SearchParams searchParams(32);
+        index->knnSearch(queryDescriptors, scratch.indices, scratch.flannDistances, k, searchParams);
+        // The KD-tree reports squared L2 distances, LSH integer Hamming distances
+        if (backend == MatcherBackend::FLANN_KDTREE)
+        {
+            scratch.distances.create(scratch.flannDistances.size(), CV_32F);
+            cv::sqrt(scratch.flannDistances, scratch.distances);
         }
-        case FeatureDetectorMethod::ORB: {
-            cv::Ptr<cv::ORB> orb = cv::ORB::create();
-            orb->detectAndCompute(image, cv::noArray(), features.keypoints, features.descriptors);
-            break;
+        else
+        {
+            scratch.flannDistances.convertTo(scratch.distances, CV_32F);
         }
+        break;
+    }
+    case MatcherBackend::HAMMING:
+        hamming->knnSearch(queryDescriptors, k, scratch.indices, scratch.distances);
+        break;
     default:
-        throw std::invalid_argument("Unsupported feature detector method");
+        bruteForce->knnMatch(queryDescriptors, scratch.knnMatches, k);
+        scratch.indices.create(queryDescriptors.rows, k, CV_32S);
+        scratch.distances.create(queryDescriptors.rows, k, CV_32F);
+        for (int q = 0; q < queryDescriptors.rows; ++q)
+        {
+            const std::vector<cv::DMatch> &candidates = scratch.knnMatches[q];
+            for (int j = 0; j < k; ++j)
+            {
+                const bool found = j < static_cast<int>(candidates.size());
+                scratch.indices.at<int>(q, j) = found ? candidates[j].trainIdx : -1;
+                scratch.distances.at<float>(q, j) = found ? candidates[j].distance : FLT_MAX;
+            }
+        }
+        break;
     }
+}
 
-    cv::drawKeypoints(image, features.keypoints, features.imageWithKeypoints);
-    return features;
+void FeatureMatcher::matchRows(const cv::Mat &queryDescriptors, std::vector<MatchPair> &matches, MatchScratch &scratch,
+                               double &indexBuildTimeMs, double &queryTimeMs) const
+{
+    matches.clear();
+    indexBuildTimeMs = buildTimeMs;
+    queryTimeMs = 0.0;
+    if (referenceDescriptors.empty() || queryDescriptors.empty())
+        return;
+
+    if (queryDescriptors.type() != referenceDescriptors.type() || queryDescriptors.cols != referenceDescriptors.cols)
+    {
+        throw std::invalid_argument("Query and reference descriptors are of different types");
+    }
+
+    const bool useRatio = options.ratio > 0.0f;
+    const int k = useRatio ? 2 : 1;
+
+    auto queryStart = std::chrono::high_resolution_clock::now();
+    knnSearch(queryDescriptors, k, scratch);
+    auto queryEnd = std::chrono::high_resolution_clock::now();
+    queryTimeMs += std::chrono::duration<double, std::milli>(queryEnd - queryStart).count();
+
+    for (int q = 0; q < queryDescriptors.rows; ++q)
+    {
+        const int *indices = scratch.indices.ptr<int>(q);
+        const float *distances = scratch.distances.ptr<float>(q);
+        if (indices[0] < 0)
+            continue;
+        if (useRatio && indices[1] >= 0 && distances[0] >= options.ratio * distances[1])
+            continue;
+        matches.push_back({q, indices[0], distances[0]});
+    }
+
+    // Keep only matches that are also nearest neighbours in the reverse direction
+    if (options.crossCheck)
+    {
+        MatchOptions reverseOptions;
+        reverseOptions.backend = backend;
+        FeatureMatcher reverseMatcher(queryDescriptors, reverseOptions);
+        indexBuildTimeMs += reverseMatcher.buildTimeMs;
+
+        MatchScratch reverseScratch;
+        queryStart = std::chrono::high_resolution_clock::now();
+        reverseMatcher.knnSearch(referenceDescriptors, 1, reverseScratch);
+        queryEnd = std::chrono::high_resolution_clock::now();
+        queryTimeMs += std::chrono::duration<double, std::milli>(queryEnd - queryStart).count();
+
+        size_t kept = 0;
+        for (const MatchPair &m : matches)
+        {
+            if (reverseScratch.indices.at<int>(m.train, 0) == m.query)
+                matches[kept++] = m;
+        }
+        matches.resize(kept);
+    }
+}
+
+FeatureMatches FeatureMatcher::match(const ImageFeatures &query) const
+{
+    FeatureMatches result;
+    MatchScratch scratch;
+    std::vector<MatchPair> pairs;
+    matchRows(query.descriptors, pairs, scratch, result.indexBuildTimeMs, result.queryTimeMs);
+
+    result.matchingTimeMs = result.indexBuildTimeMs + result.queryTimeMs;
+    result.matches.reserve(pairs.size());
+    result.distances.reserve(pairs.size());
+    for (const MatchPair &pair : pairs)
+    {
+        result.matches.push_back(cv::DMatch(pair.query, pair.train, 0, pair.distance));
+        result.distances.push_back(pair.distance);
+    }
+    return result;
+}
+
+MatchSet FeatureMatcher::match(const FeatureSet &query) const
+{
+    MatchSet result;
+    MatchScratch scratch;
+    match(matchableDescriptors(query), result, scratch);
+    return result;
+}
+
+void FeatureMatcher::match(const cv::Mat &queryDescriptors, MatchSet &result, MatchScratch &scratch) const
+{
+    matchRows(queryDescriptors, result.pairs, scratch, result.indexBuildTimeMs, result.queryTimeMs);
+}
+
+FeatureMatches match_features(const ImageFeatures &features1, const ImageFeatures &features2, const MatchOptions &options)
+{
+    ScopedTimer timer("match_features", "matching");
+    FeatureMatcher matcher(features2, options);
+    FeatureMatches matches = matcher.match(features1);
+
+    Profiler &profiler = Profiler::instance();
+    profiler.addCounter("matches", static_cast<double>(matches.matches.size()));
+    profiler.recordMetric("matches", static_cast<double>(matches.matches.size()));
+    profiler.recordMetric("index_build_ms", matches.indexBuildTimeMs);
+    profiler.recordMetric("query_ms", matches.queryTimeMs);
+    return matches;
+}
+
+void FeatureSet::reserve(std::size_t count)
+{
+    x.reserve(count);
+    y.reserve(count);
+    scale.reserve(count);
+    angle.reserve(count);
+    response.reserve(count);
+}
+
+void FeatureSet::push_back(const cv::KeyPoint &keypoint)
+{
+    x.push_back(keypoint.pt.x);
+    y.push_back(keypoint.pt.y);
+    scale.push_back(keypoint.size);
+    angle.push_back(keypoint.angle);
+    response.push_back(keypoint.response);
+}
+
+FeatureSet to_feature_set(const ImageFeatures &features, const FeatureDetectorMethod method)
+{
+    FeatureSet set;
+    set.reserve(features.keypoints.size());
+    for (const auto &keypoint : features.keypoints)
+    {
+        set.push_back(keypoint);
+    }
+
+    set.descriptorNorm = method == FeatureDetectorMethod::ORB ? cv::NORM_HAMMING : cv::NORM_L2;
+    if (features.descriptors.depth() == CV_32F)
+    {
+        features.descriptors.convertTo(set.descriptors, CV_8U);
+        set.floatDescriptors = features.descriptors;
+    }
+    else
+        set.descriptors = features.descriptors;
+    return set;
+}
+
+std::vector<cv::KeyPoint> to_keypoints(const FeatureSet &features)
+{
+    std::vector<cv::KeyPoint> keypoints(features.size());
+    for (size_t i = 0; i < keypoints.size(); ++i)
+    {
+        keypoints[i] = cv::KeyPoint(features.x[i], features.y[i], features.scale[i], features.angle[i], features.response[i]);
+    }
+    return keypoints;
+}
+
+MatchSet to_match_set(const FeatureMatches &matches)
+{
+    MatchSet set;
+    set.indexBuildTimeMs = matches.indexBuildTimeMs;
+    set.queryTimeMs = matches.queryTimeMs;
+    set.pairs.resize(matches.matches.size());
+    for (size_t i = 0; i < set.pairs.size(); ++i)
+    {
+        const cv::DMatch &match = matches.matches[i];
+        set.pairs[i] = {match.queryIdx, match.trainIdx, match.distance};
+    }
+    return set;
+}
+
+FeatureMatches to_feature_matches(const MatchSet &matches)
+{
+    FeatureMatches result;
+    result.indexBuildTimeMs = matches.indexBuildTimeMs;
+    result.queryTimeMs = matches.queryTimeMs;
+    result.matchingTimeMs = matches.indexBuildTimeMs + matches.queryTimeMs;
+    result.matches.reserve(matches.pairs.size());
+    result.distances.reserve(matches.pairs.size());
+    for (const auto &pair : matches.pairs)
+    {
+        result.matches.emplace_back(pair.query, pair.train, pair.distance);
+        result.distances.push_back(pair.distance);
+    }
+    return result;
+}
+
+FeatureSet extract_feature_set(const cv::Mat &image, const FeatureDetectorMethod method, const ExtractionOptions &options)
+{
+    // The detectors only produce cv::KeyPoint vectors, so the transpose happens once right here
+    ExtractionOptions detectOnly = options;
+    detectOnly.drawKeypoints = false;
+    return to_feature_set(extract_features(image, method, detectOnly), method);
+}
+
+static void recordMatchMetrics(const MatchSet &matches)
+{
+    Profiler &profiler = Profiler::instance();
+    profiler.addCounter("matches", static_cast<double>(matches.pairs.size()));
+    profiler.recordMetric("matches", static_cast<double>(matches.pairs.size()));
+    profiler.recordMetric("index_build_ms", matches.indexBuildTimeMs);
+    profiler.recordMetric("query_ms", matches.queryTimeMs);
+}
+
+MatchSet match_feature_sets(const FeatureSet &features1, const FeatureSet &features2, const MatchOptions &options)
+{
+    ScopedTimer timer("match_features", "matching");
+    FeatureMatcher matcher(features2, options);
+    MatchSet matches = matcher.match(features1);
+    recordMatchMetrics(matches);
+    return matches;
+}
+
+namespace
+{
+// Reference keypoints bucketed into a uniform grid. Rows are stored in cell order, row-major over the
+// cells, so the candidates of consecutive cells in one grid row are one contiguous range.
+struct GuidedGrid
+{
+    float originX = 0.0f, originY = 0.0f, cellSize = 1.0f;
+    int cols = 0, rows = 0;
+    // cellStart[c] .. cellStart[c + 1] are the sorted rows of cell c
+    std::vector<int> cellStart;
+    // Reference index, position and descriptor of each sorted row
+    std::vector<int> order;
+    std::vector<float> x, y;
+    cv::Mat descriptors;
+};
 }
 
-FeatureMatches match_features(const ImageFeatures &features1, const ImageFeatures &features2)
+// Grids are capped at this many cells per side, larger extents get larger cells
+static const int MAX_GRID_CELLS = 1024;
+
+static GuidedGrid buildGuidedGrid(const FeatureSet &reference, float cellSize)
 {
-    cv::BFMatcher matcher(cv::NORM_L2);
-    std::vector<cv::DMatch> matches;
+    GuidedGrid grid;
+    const auto rangeX = std::minmax_element(reference.x.begin(), reference.x.end());
+    const auto rangeY = std::minmax_element(reference.y.begin(), reference.y.end());
+    const float extent = std::max(*rangeX.second - *rangeX.first, *rangeY.second - *rangeY.first);
+    grid.originX = *rangeX.first;
+    grid.originY = *rangeY.first;
+    grid.cellSize = std::max({cellSize, extent / MAX_GRID_CELLS, 1.0f});
+    grid.cols = std::min(MAX_GRID_CELLS, static_cast<int>((*rangeX.second - grid.originX) / grid.cellSize) + 1);
+    grid.rows = std::min(MAX_GRID_CELLS, static_cast<int>((*rangeY.second - grid.originY) / grid.cellSize) + 1);
 
-    auto matchStart = std::chrono::high_resolution_clock::now();
-    matcher.match(features1.descriptors, features2.descriptors, matches);
-    auto matchEnd = std::chrono::high_resolution_clock::now();
-    std::chrono::duration<double, std::milli> elapsed = matchEnd - matchStart;
-    double matchingTimeMs = elapsed.count();
+    // Counting sort of the keypoints by cell
+    const int n = static_cast<int>(reference.size());
+    std::vector<int> cellOf(n);
+    grid.cellStart.assign(grid.cols * grid.rows + 1, 0);
+    for (int i = 0; i < n; ++i)
+    {
+        const int col = std::min(grid.cols - 1, static_cast<int>((reference.x[i] - grid.originX) / grid.cellSize));
+        const int row = std::min(grid.rows - 1, static_cast<int>((reference.y[i] - grid.originY) / grid.cellSize));
+        cellOf[i] = row * grid.cols + col;
+        ++grid.cellStart[cellOf[i] + 1];
+    }
+    std::partial_sum(grid.cellStart.begin(), grid.cellStart.end(), grid.cellStart.begin());
 
-    std::vector<float> distances;
-    for (const auto &match : matches)
+    std::vector<int> next(grid.cellStart.begin(), grid.cellStart.end() - 1);
+    grid.order.resize(n);
+    for (int i = 0; i < n; ++i)
     {
-        distances.push_back(match.distance);
+        grid.order[next[cellOf[i]]++] = i;
     }
-    return {matches, distances, matchingTimeMs};
+
+    grid.x.resize(n);
+    grid.y.resize(n);
+    grid.descriptors.create(n, reference.descriptors.cols, reference.descriptors.type());
+    const size_t rowBytes = reference.descriptors.cols * reference.descriptors.elemSize();
+    for (int k = 0; k < n; ++k)
+    {
+        grid.x[k] = reference.x[grid.order[k]];
+        grid.y[k] = reference.y[grid.order[k]];
+        std::memcpy(grid.descriptors.ptr(k), reference.descriptors.ptr(grid.order[k]), rowBytes);
+    }
+    return grid;
 }
 
+MatchSet match_feature_sets_guided(const FeatureSet &query, const FeatureSet &reference, const cv::Matx33d &prior,
+                                   const GuidedMatchOptions &options)
+{
+    ScopedTimer timer("match_features_guided", "matching");
+    MatchSet matches;
+    if (query.size() == 0 || reference.size() == 0 || query.descriptors.empty() || reference.descriptors.empty())
+        return matches;
+    if (query.descriptors.type() != reference.descriptors.type() || query.descriptors.cols != reference.descriptors.cols)
+    {
+        throw std::invalid_argument("Query and reference descriptors are of different types");
+    }
+    if (query.descriptors.depth() != CV_8U && query.descriptors.depth() != CV_32F)
+    {
+        throw std::invalid_argument("Guided matching needs CV_8U or CV_32F descriptors");
+    }
+
+    auto buildStart = std::chrono::high_resolution_clock::now();
+    const float radius = std::max(options.radius, 0.0f);
+    const GuidedGrid grid = buildGuidedGrid(reference, options.cellSize > 0.0f ? options.cellSize : radius);
+    auto buildEnd = std::chrono::high_resolution_clock::now();
+    matches.indexBuildTimeMs = std::chrono::duration<double, std::milli>(buildEnd - buildStart).count();
+
+    const bool binary = reference.descriptorNorm == cv::NORM_HAMMING;
+    const int length = reference.descriptors.cols;
+    const HammingKernel hamming = binary ? select_hamming_kernel(length) : nullptr;
+    const bool useRatio = options.ratio > 0.0f;
+    const float radius2 = radius * radius;
+    const int n = static_cast<int>(query.size());
+    // One slot per query keeps the result independent of how the queries are split across threads
+    std::vector<MatchPair> found(n, MatchPair{0, -1, 0.0f});
+
+    cv::parallel_for_(cv::Range(0, n), [&](const cv::Range &range)
+    {
+        std::vector<int> distances;
+        for (int i = range.start; i < range.end; ++i)
+        {
+            const cv::Vec3d p = prior * cv::Vec3d(query.x[i], query.y[i], 1.0);
+            if (p[2] <= 1e-9)
+                continue;
+            const float px = static_cast<float>(p[0] / p[2]), py = static_cast<float>(p[1] / p[2]);
+            const float minCol = std::floor((px - radius - grid.originX) / grid.cellSize);
+            const float maxCol = std::floor((px + radius - grid.originX) / grid.cellSize);
+            const float minRow = std::floor((py - radius - grid.originY) / grid.cellSize);
+            const float maxRow = std::floor((py + radius - grid.originY) / grid.cellSize);
+            if (maxCol < 0.0f || maxRow < 0.0f || minCol >= grid.cols || minRow >= grid.rows)
+                continue;
+            const int col0 = std::max(0, static_cast<int>(minCol)), col1 = std::min(grid.cols - 1, static_cast<int>(maxCol));
+            const int row0 = std::max(0, static_cast<int>(minRow)), row1 = std::min(grid.rows - 1, static_cast<int>(maxRow));
+
+            const uchar *descriptor = query.descriptors.ptr(i);
+            float best = std::numeric_limits<float>::max(), second = best;
+            int bestRow = -1;
+            for (int row = row0; row <= row1; ++row)
+            {
+                const int begin = grid.cellStart[row * grid.cols + col0];
+                const int end = grid.cellStart[row * grid.cols + col1 + 1];
+                if (begin == end)
+                    continue;
+                if (binary)
+                {
+                    distances.resize(std::max(distances.size(), static_cast<size_t>(end - begin)));
+                    hamming(descriptor, grid.descriptors.ptr(begin), grid.descriptors.step, end - begin, length, distances.data());
+                }
+                for (int k = begin; k < end; ++k)
+                {
+                    const float dx = grid.x[k] - px, dy = grid.y[k] - py;
+                    if (dx * dx + dy * dy > radius2)
+                        continue;
+                    float distance;
+                    if (binary)
+                        distance = static_cast<float>(distances[k - begin]);
+                    else if (grid.descriptors.depth() == CV_8U)
+                        distance = std::sqrt(static_cast<float>(cv::normL2Sqr<uchar, int>(descriptor, grid.descriptors.ptr(k), length)));
+                    else
+                        distance = std::sqrt(cv::normL2Sqr<float, float>(reinterpret_cast<const float *>(descriptor), grid.descriptors.ptr<float>(k), length));
+
+                    if (distance < best)
+                    {
+                        second = best;
+                        best = distance;
+                        bestRow = k;
+                    }
+                    else if (distance < second)
+                    {
+                        second = distance;
+                    }
+                }
+            }
+            if (bestRow < 0)
+                continue;
+            if (useRatio && second < std::numeric_limits<float>::max() && best >= options.ratio * second)
+                continue;
+            found[i] = {i, grid.order[bestRow], best};
+        }
+    });
+
+    matches.pairs.reserve(n);
+    for (const MatchPair &pair : found)
+    {
+        if (pair.train >= 0)
+            matches.pairs.push_back(pair);
+    }
+    auto queryEnd = std::chrono::high_resolution_clock::now();
+    matches.queryTimeMs = std::chrono::duration<double, std::milli>(queryEnd - buildEnd).count();
+    recordMatchMetrics(matches);
+    return matches;
+}
 
+const FeatureSet &extract_feature_set(const cv::Mat &image, const FeatureDetectorMethod method, int slot, PipelineContext &context)
+{
+    ScopedTimer timer("extract_features", "features");
+    if (!context.detector || context.detectorMethod != method)
+    {
+        context.detector = createDetector(method);
+        context.detectorMethod = method;
+    }
+    context.detector->detectAndCompute(image, cv::noArray(), context.keypoints, context.descriptors);
+
+    FeatureSet &features = context.features[slot];
+    features.x.clear();
+    features.y.clear();
+    features.scale.clear();
+    features.angle.clear();
+    features.response.clear();
+    for (const auto &keypoint : context.keypoints)
+    {
+        features.push_back(keypoint);
+    }
+    features.descriptorNorm = method == FeatureDetectorMethod::ORB ? cv::NORM_HAMMING : cv::NORM_L2;
+    // Rows differ from image to image, a view keeps the buffer at the largest count seen so far
+    features.descriptors = acquireBuffer(context.descriptorStorage[slot], context.descriptors.size(), CV_8U);
+    if (!context.descriptors.empty())
+        context.descriptors.convertTo(features.descriptors, CV_8U);
+
+    Profiler::instance().addCounter("keypoints", static_cast<double>(features.size()));
+    Profiler::instance().recordMetric("keypoints", static_cast<double>(features.size()));
+    return features;
+}
+
+const MatchSet &match_feature_sets(const FeatureSet &features1, const FeatureSet &features2, PipelineContext &context,
+                                   const MatchOptions &options)
+{
+    ScopedTimer timer("match_features", "matching");
+    context.matcher.train(matchableDescriptors(features2, context.matchDescriptors[1]), options);
+    context.matcher.match(matchableDescriptors(features1, context.matchDescriptors[0]), context.matches, context.matchScratch);
+    recordMatchMetrics(context.matches);
+    return context.matches;
+}
@@ -1,6 +1,7 @@
 #pragma once
 #include <opencv2/opencv.hpp>
 #include <matplot/matplot.h>
+#include <cstdint>
 #include <vector>
 #include <string>
 #include <stdexcept>
@@ -11,6 +12,20 @@ enum class FeatureDetectorMethod {
     ORB
 };
 
+struct ExtractionOptions {
+    // Detect on overlapping tiles in parallel instead of in one pass over the whole image
+    bool tiled = false;
+    int tileSize = 512;
+    // Context added around each tile, so keypoints near its border see the same neighbourhood as in the full image
+    int tileOverlap = 32;
+    // Strongest keypoints kept per tile, for even spatial coverage; unlimited when <= 0
+    int maxKeypointsPerTile = 0;
+    // Strongest keypoints kept for an untiled pass; the detector's default (all for SIFT, 500 for ORB) when <= 0
+    int maxKeypoints = 0;
+    // Render imageWithKeypoints, a full-size copy that is only needed for visualization
+    bool drawKeypoints = false;
+};
+
 struct ImageFeatures {
     std::vector<cv::KeyPoint> keypoints;
     cv::Mat descriptors;
@@ -21,9 +36,137 @@ struct FeatureMatches {
     std::vector<cv::DMatch> matches;
     std::vector<float> distances;
     double matchingTimeMs;
+    double indexBuildTimeMs;
+    double queryTimeMs;
+};
+
+// Keypoints of one image as contiguous per-field arrays. The estimators only read positions, which sit
+// in two dense float arrays here instead of being strided through 28-byte cv::KeyPoint structs.
+struct FeatureSet {
+    std::vector<float> x, y, scale, angle, response;
+    // One row per keypoint. SIFT rows are stored as CV_8U: OpenCV already rounds and clamps them to
+    // [0, 255], so the quantization is lossless and takes a quarter of the memory.
+    cv::Mat descriptors;
+    // The detector's CV_32F rows of a SIFT set, shared rather than copied, which the KD-tree and L2 matchers
+    // index directly instead of converting descriptors back on every match. Empty for ORB and context sets.
+    cv::Mat floatDescriptors;
+    // cv::NORM_L2 for SIFT, cv::NORM_HAMMING for ORB
+    int descriptorNorm = cv::NORM_L2;
+
+    std::size_t size() const { return x.size(); }
+    void reserve(std::size_t count);
+    void push_back(const cv::KeyPoint &keypoint);
+};
+
+// 12 bytes per match instead of a 16-byte cv::DMatch plus a second copy of its distance
+struct MatchPair {
+    std::int32_t query;
+    std::int32_t train;
+    float distance;
+};
+
+struct MatchSet {
+    std::vector<MatchPair> pairs;
+    double indexBuildTimeMs = 0.0;
+    double queryTimeMs = 0.0;
+};
+
+struct PipelineContext;
+
+enum class MatcherBackend {
+    AUTO,
+    BRUTE_FORCE,
+    FLANN_KDTREE,
+    FLANN_LSH,
+    HAMMING
+};
+
+struct MatchOptions {
+    MatcherBackend backend = MatcherBackend::AUTO;
+    // Lowe ratio test threshold, disabled when <= 0
+    float ratio = 0.0f;
+    bool crossCheck = false;
+};
+
+// Matching with a prior homography: each query keypoint is only compared against the reference keypoints
+// within radius of where the prior maps it, found through a uniform grid over the reference positions
+struct GuidedMatchOptions {
+    // Search radius around the predicted position, in reference image pixels
+    float radius = 16.0f;
+    // Side of a grid cell; the radius when <= 0
+    float cellSize = 0.0f;
+    // Lowe ratio test among the candidates inside the search window, disabled when <= 0
+    float ratio = 0.0f;
+};
+
+// k nearest neighbours of every query row as query.rows x k matrices, kept between calls so that matching
+// allocates nothing once they have grown: indices (CV_32S, -1 past the last neighbour) and distances (CV_32F)
+struct MatchScratch {
+    cv::Mat indices, distances;
+    // Raw FLANN distances (squared L2, or integer Hamming for LSH) before conversion
+    cv::Mat flannDistances;
+    std::vector<std::vector<cv::DMatch>> knnMatches;
+};
+
+class HammingMatcher;
+
+// Nearest-neighbour matcher whose search index over the reference (train) descriptors is built once
+// and reused for every query. AUTO picks a KD-tree for float descriptors (SIFT) and the vectorized
+// exact Hamming matcher for binary descriptors (ORB).
+class FeatureMatcher {
+public:
+    explicit FeatureMatcher(const MatchOptions &options = MatchOptions());
+    FeatureMatcher(const cv::Mat &referenceDescriptors, const MatchOptions &options = MatchOptions());
+    FeatureMatcher(const ImageFeatures &reference, const MatchOptions &options = MatchOptions());
+    FeatureMatcher(const FeatureSet &reference, const MatchOptions &options = MatchOptions());
+
+    // Switch to new reference descriptors, which must outlive the matcher's use of them. The matcher objects
+    // are kept; a FLANN index depends on the data and is rebuilt in place.
+    void train(const cv::Mat &referenceDescriptors, const MatchOptions &options);
+
+    FeatureMatches match(const ImageFeatures &query) const;
+    MatchSet match(const FeatureSet &query) const;
+    // Fills result in place; queryDescriptors must already have the reference's type
+    void match(const cv::Mat &queryDescriptors, MatchSet &result, MatchScratch &scratch) const;
+    double indexBuildTimeMs() const { return buildTimeMs; }
+
+private:
+    // k nearest reference rows of every query row into scratch.indices and scratch.distances
+    void knnSearch(const cv::Mat &queryDescriptors, int k, MatchScratch &scratch) const;
+    // Nearest neighbour of every query row that passes the ratio test and cross-check
+    void matchRows(const cv::Mat &queryDescriptors, std::vector<MatchPair> &matches, MatchScratch &scratch, double &indexBuildTimeMs,
+                   double &queryTimeMs) const;
+
+    cv::Mat referenceDescriptors;
+    MatchOptions options;
+    MatcherBackend backend = MatcherBackend::AUTO;
+    // One of these is set, depending on the backend
+    cv::Ptr<cv::flann::Index> index;
+    cv::Ptr<HammingMatcher> hamming;
+    cv::Ptr<cv::DescriptorMatcher> bruteForce;
+    double buildTimeMs = 0.0;
 };
 
 cv::Mat load_image(const std::string &path);
-ImageFeatures extract_features(const cv::Mat &image, const FeatureDetectorMethod method = FeatureDetectorMethod::SIFT);
-FeatureMatches match_features(const ImageFeatures &features1, const ImageFeatures &features2);
+ImageFeatures extract_features(const cv::Mat &image, const FeatureDetectorMethod method = FeatureDetectorMethod::SIFT,
+                               const ExtractionOptions &options = ExtractionOptions());
+FeatureMatches match_features(const ImageFeatures &features1, const ImageFeatures &features2, const MatchOptions &options = MatchOptions());
+// Structure-of-arrays path: extract -> match -> estimate without cv::KeyPoint or cv::DMatch vectors in between
+FeatureSet extract_feature_set(const cv::Mat &image, const FeatureDetectorMethod method = FeatureDetectorMethod::SIFT,
+                               const ExtractionOptions &options = ExtractionOptions());
+MatchSet match_feature_sets(const FeatureSet &features1, const FeatureSet &features2, const MatchOptions &options = MatchOptions());
+// Guided matching; prior maps query positions into the reference image, e.g. the homography of the previous
+// frame or of a coarse pass. Near-linear in the number of keypoints instead of quadratic.
+MatchSet match_feature_sets_guided(const FeatureSet &query, const FeatureSet &reference, const cv::Matx33d &prior,
+                                   const GuidedMatchOptions &options = GuidedMatchOptions());
+// Same, filling context.features[slot] and context.matches in place from buffers the context keeps
+// between pairs (untiled detection only)
+const FeatureSet &extract_feature_set(const cv::Mat &image, const FeatureDetectorMethod method, int slot, PipelineContext &context);
+const MatchSet &match_feature_sets(const FeatureSet &features1, const FeatureSet &features2, PipelineContext &context,
+                                   const MatchOptions &options = MatchOptions());
+// Adapters between the structure-of-arrays containers and the OpenCV types
+FeatureSet to_feature_set(const ImageFeatures &features, const FeatureDetectorMethod method);
+std::vector<cv::KeyPoint> to_keypoints(const FeatureSet &features);
+MatchSet to_match_set(const FeatureMatches &matches);
+FeatureMatches to_feature_matches(const MatchSet &matches);
 void doFeatureDetection();
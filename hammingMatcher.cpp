@@ -0,0 +1,266 @@
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <cfloat>
+#include <cstdint>
+#include <cstring>
+#include <hammingMatcher.h>
+
+// x86-64 only: the kernels read 64-bit lanes with _mm_cvtsi128_si64, which 32-bit x86 does not have
+#if defined(__GNUC__) && defined(__x86_64__)
+#define HAMMING_X86_DISPATCH 1
+#include <immintrin.h>
+#endif
+
+static inline int popcount64(std::uint64_t x)
+{
+#if defined(__GNUC__)
+    return __builtin_popcountll(x);
+#else
+    x = x - ((x >> 1) & 0x5555555555555555ULL);
+    x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+    x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+    return static_cast<int>((x * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+static void hammingScalar(const uchar *query, const uchar *train, size_t step, int count, int bytes, int *distances)
+{
+    for (int j = 0; j < count; ++j)
+    {
+        const uchar *row = train + j * step;
+        int distance = 0;
+        int i = 0;
+        for (; i + 8 <= bytes; i += 8)
+        {
+            std::uint64_t a, b;
+            std::memcpy(&a, query + i, 8);
+            std::memcpy(&b, row + i, 8);
+            distance += popcount64(a ^ b);
+        }
+        for (; i < bytes; ++i)
+        {
+            distance += popcount64(static_cast<std::uint64_t>(query[i] ^ row[i]));
+        }
+        distances[j] = distance;
+    }
+}
+
+#ifdef HAMMING_X86_DISPATCH
+// 32-byte rows: per-nibble popcount through a shuffle lookup table, summed with vpsadbw
+__attribute__((target("avx2"))) static void hammingAvx2(const uchar *query, const uchar *train, size_t step, int count, int, int *distances)
+{
+    const __m256i lut = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                         0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i lowNibble = _mm256_set1_epi8(0x0f);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i q = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(query));
+
+    for (int j = 0; j < count; ++j)
+    {
+        __m256i x = _mm256_xor_si256(q, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(train + j * step)));
+        __m256i lo = _mm256_shuffle_epi8(lut, _mm256_and_si256(x, lowNibble));
+        __m256i hi = _mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_srli_epi16(x, 4), lowNibble));
+        __m256i sums = _mm256_sad_epu8(_mm256_add_epi8(lo, hi), zero);
+        __m128i s = _mm_add_epi64(_mm256_castsi256_si128(sums), _mm256_extracti128_si256(sums, 1));
+        distances[j] = static_cast<int>(_mm_cvtsi128_si64(s) + _mm_cvtsi128_si64(_mm_unpackhi_epi64(s, s)));
+    }
+}
+
+// 32-byte rows, two train rows per 512-bit register with native 64-bit popcount
+__attribute__((target("avx2,avx512f,avx512vpopcntdq"))) static void hammingAvx512(const uchar *query, const uchar *train, size_t step, int count, int bytes, int *distances)
+{
+    const __m512i q = _mm512_broadcast_i64x4(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(query)));
+
+    int j = 0;
+    for (; j + 2 <= count; j += 2)
+    {
+        __m256i r0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(train + j * step));
+        __m256i r1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(train + (j + 1) * step));
+        __m512i rows = _mm512_inserti64x4(_mm512_castsi256_si512(r0), r1, 1);
+        __m512i counts = _mm512_popcnt_epi64(_mm512_xor_si512(q, rows));
+
+        __m256i c0 = _mm512_castsi512_si256(counts);
+        __m256i c1 = _mm512_extracti64x4_epi64(counts, 1);
+        __m128i s0 = _mm_add_epi64(_mm256_castsi256_si128(c0), _mm256_extracti128_si256(c0, 1));
+        __m128i s1 = _mm_add_epi64(_mm256_castsi256_si128(c1), _mm256_extracti128_si256(c1, 1));
+        distances[j] = static_cast<int>(_mm_cvtsi128_si64(s0) + _mm_cvtsi128_si64(_mm_unpackhi_epi64(s0, s0)));
+        distances[j + 1] = static_cast<int>(_mm_cvtsi128_si64(s1) + _mm_cvtsi128_si64(_mm_unpackhi_epi64(s1, s1)));
+    }
+    if (j < count)
+    {
+        hammingScalar(query, train + j * step, step, count - j, bytes, distances + j);
+    }
+}
+#endif
+
+HammingKernel select_hamming_kernel(int bytes)
+{
+#ifdef HAMMING_X86_DISPATCH
+    if (bytes == 32)
+    {
+        static const bool hasAvx512 = __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vpopcntdq");
+        static const bool hasAvx2 = __builtin_cpu_supports("avx2");
+        if (hasAvx512)
+            return hammingAvx512;
+        if (hasAvx2)
+            return hammingAvx2;
+    }
+#endif
+    return hammingScalar;
+}
+
+const char *hamming_kernel_name(int bytes)
+{
+    HammingKernel kernel = select_hamming_kernel(bytes);
+#ifdef HAMMING_X86_DISPATCH
+    if (kernel == hammingAvx512)
+        return "avx512-vpopcntdq";
+    if (kernel == hammingAvx2)
+        return "avx2";
+#endif
+    (void)kernel;
+    return "scalar";
+}
+
+cv::Ptr<cv::DescriptorMatcher> HammingMatcher::clone(bool emptyTrainData) const
+{
+    cv::Ptr<HammingMatcher> matcher = cv::makePtr<HammingMatcher>();
+    if (!emptyTrainData)
+    {
+        for (const auto &descriptors : trainDescCollection)
+        {
+            matcher->trainDescCollection.push_back(descriptors.clone());
+        }
+    }
+    return matcher;
+}
+
+void HammingMatcher::setTrainDescriptors(const cv::Mat &descriptors)
+{
+    utrainDescCollection.clear();
+    trainDescCollection.resize(1);
+    trainDescCollection[0] = descriptors;
+}
+
+// Insert a candidate into a row of k slots sorted by distance, dropping the farthest
+static inline void insertCandidate(int *indices, float *distances, int k, int index, float distance)
+{
+    if (distance >= distances[k - 1])
+        return;
+    int i = k - 1;
+    for (; i > 0 && distances[i - 1] > distance; --i)
+    {
+        indices[i] = indices[i - 1];
+        distances[i] = distances[i - 1];
+    }
+    indices[i] = index;
+    distances[i] = distance;
+}
+
+void HammingMatcher::knnSearch(const cv::Mat &query, int k, cv::Mat &indices, cv::Mat &distances) const
+{
+    CV_Assert(query.depth() == CV_8U && k > 0);
+    for (const auto &train : trainDescCollection)
+    {
+        CV_Assert(train.type() == query.type() && train.cols == query.cols);
+    }
+
+    const int bytes = query.cols * static_cast<int>(query.elemSize());
+    const HammingKernel kernel = select_hamming_kernel(bytes);
+    indices.create(query.rows, k, CV_32S);
+    distances.create(query.rows, k, CV_32F);
+
+    const int numTiles = (query.rows + QUERY_TILE - 1) / QUERY_TILE;
+    cv::parallel_for_(cv::Range(0, numTiles), [&](const cv::Range &range)
+    {
+        int tileDistances[TRAIN_TILE];
+        for (int tile = range.start; tile < range.end; ++tile)
+        {
+            const int q0 = tile * QUERY_TILE;
+            const int q1 = std::min(q0 + QUERY_TILE, query.rows);
+            for (int q = q0; q < q1; ++q)
+            {
+                std::fill_n(indices.ptr<int>(q), k, -1);
+                std::fill_n(distances.ptr<float>(q), k, FLT_MAX);
+            }
+
+            // The query tile stays resident while a train tile is streamed past all of its rows
+            int offset = 0;
+            for (const cv::Mat &train : trainDescCollection)
+            {
+                for (int t0 = 0; t0 < train.rows; t0 += TRAIN_TILE)
+                {
+                    const int count = std::min(TRAIN_TILE, train.rows - t0);
+                    for (int q = q0; q < q1; ++q)
+                    {
+                        int *rowIndices = indices.ptr<int>(q);
+                        float *rowDistances = distances.ptr<float>(q);
+                        kernel(query.ptr<uchar>(q), train.ptr<uchar>(t0), train.step, count, bytes, tileDistances);
+                        for (int j = 0; j < count; ++j)
+                        {
+                            insertCandidate(rowIndices, rowDistances, k, offset + t0 + j, static_cast<float>(tileDistances[j]));
+                        }
+                    }
+                }
+                offset += train.rows;
+            }
+        }
+    });
+}
+
+void HammingMatcher::knnMatchImpl(cv::InputArray queryDescriptors, std::vector<std::vector<cv::DMatch>> &matches, int k,
+                                  cv::InputArrayOfArrays, bool)
+{
+    cv::Mat query = queryDescriptors.getMat();
+    cv::Mat indices, distances;
+    knnSearch(query, k, indices, distances);
+
+    matches.assign(query.rows, std::vector<cv::DMatch>());
+    for (int q = 0; q < query.rows; ++q)
+    {
+        const int *rowIndices = indices.ptr<int>(q);
+        const float *rowDistances = distances.ptr<float>(q);
+        for (int j = 0; j < k && rowIndices[j] >= 0; ++j)
+        {
+            // Map the index across the collection back to its image
+            int imgIdx = 0, trainIdx = rowIndices[j];
+            while (trainIdx >= trainDescCollection[imgIdx].rows)
+            {
+                trainIdx -= trainDescCollection[imgIdx].rows;
+                ++imgIdx;
+            }
+            matches[q].push_back(cv::DMatch(q, trainIdx, imgIdx, rowDistances[j]));
+        }
+    }
+}
+
+void HammingMatcher::radiusMatchImpl(cv::InputArray queryDescriptors, std::vector<std::vector<cv::DMatch>> &matches, float maxDistance,
+                                     cv::InputArrayOfArrays, bool)
+{
+    cv::Mat query = queryDescriptors.getMat();
+    CV_Assert(query.depth() == CV_8U);
+
+    const int bytes = query.cols * static_cast<int>(query.elemSize());
+    const HammingKernel kernel = select_hamming_kernel(bytes);
+    matches.assign(query.rows, std::vector<cv::DMatch>());
+
+    cv::parallel_for_(cv::Range(0, query.rows), [&](const cv::Range &range)
+    {
+        std::vector<int> distances;
+        for (int q = range.start; q < range.end; ++q)
+        {
+            for (int imgIdx = 0; imgIdx < static_cast<int>(trainDescCollection.size()); ++imgIdx)
+            {
+                const cv::Mat &train = trainDescCollection[imgIdx];
+                distances.resize(train.rows);
+                kernel(query.ptr<uchar>(q), train.ptr<uchar>(), train.step, train.rows, bytes, distances.data());
+                for (int j = 0; j < train.rows; ++j)
+                {
+                    if (distances[j] < maxDistance)
+                        matches[q].push_back(cv::DMatch(q, j, imgIdx, static_cast<float>(distances[j])));
+                }
+            }
+            std::sort(matches[q].begin(), matches[q].end());
+        }
+    });
+}
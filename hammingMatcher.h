@@ -0,0 +1,36 @@
+#pragma once
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+// Hamming distances from one binary descriptor to `count` train rows spaced `step` bytes apart
+typedef void (*HammingKernel)(const uchar *query, const uchar *train, size_t step, int count, int bytes, int *distances);
+
+// Fastest kernel supported by the running CPU for descriptors of the given length
+// (AVX-512 VPOPCNTDQ or AVX2 for 32-byte ORB rows, portable popcount otherwise)
+HammingKernel select_hamming_kernel(int bytes);
+const char *hamming_kernel_name(int bytes);
+
+// Exact brute-force matcher for binary descriptors (e.g. ORB) built on the vectorized Hamming kernels.
+// Query and train rows are processed in tiles that fit into L1/L2, and query tiles are matched in parallel.
+// Plugs into cv::DescriptorMatcher, so add()/train()/knnMatch() behave like cv::BFMatcher(cv::NORM_HAMMING).
+class HammingMatcher : public cv::DescriptorMatcher {
+public:
+    static constexpr int QUERY_TILE = 64;
+    static constexpr int TRAIN_TILE = 512;
+
+    bool isMaskSupported() const override { return false; }
+    cv::Ptr<cv::DescriptorMatcher> clone(bool emptyTrainData = false) const override;
+
+    // Replace the train set by a single descriptor matrix without copying it, the collection keeps its capacity
+    void setTrainDescriptors(const cv::Mat &descriptors);
+    // k nearest train rows of every query row, written into query.rows x k matrices that are reused when they already
+    // have that shape: indices (CV_32S, counted across the train collection) and distances (CV_32F), sorted ascending.
+    // Slots beyond the number of train rows hold -1 and FLT_MAX.
+    void knnSearch(const cv::Mat &query, int k, cv::Mat &indices, cv::Mat &distances) const;
+
+protected:
+    void knnMatchImpl(cv::InputArray queryDescriptors, std::vector<std::vector<cv::DMatch>> &matches, int k,
+                      cv::InputArrayOfArrays masks = cv::noArray(), bool compactResult = false) override;
+    void radiusMatchImpl(cv::InputArray queryDescriptors, std::vector<std::vector<cv::DMatch>> &matches, float maxDistance,
+                         cv::InputArrayOfArrays masks = cv::noArray(), bool compactResult = false) override;
+};
@@ -0,0 +1,41 @@
+#include <cstdlib>
+#include <new>
+#include <profiler.h>
+
+// Opt-in replacement of the global operator new for Profiler::trackHeapAllocations. It is not part of the
+// stitching library: only executables that list this file in their sources get it, see STITCHING_COUNT_HEAP_ALLOCATIONS.
+// The array and nothrow forms of operator new forward to this one.
+
+namespace
+{
+const bool installed = (heapCounters().installed.store(true), true);
+}
+
+void *operator new(std::size_t size)
+{
+    HeapCounters &counters = heapCounters();
+    if (counters.tracking.load(std::memory_order_relaxed))
+    {
+        counters.allocations.fetch_add(1, std::memory_order_relaxed);
+        counters.allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+    }
+    for (;;)
+    {
+        if (void *memory = std::malloc(size ? size : 1))
+            return memory;
+        std::new_handler handler = std::get_new_handler();
+        if (!handler)
+            throw std::bad_alloc();
+        handler();
+    }
+}
+
+void operator delete(void *memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void *memory, std::size_t) noexcept
+{
+    std::free(memory);
+}
@@ -1,15 +1,191 @@
+#include <iostream>
 #include <featureDetection.h>
 #include <warping.h>
+#include <ransac.h>
+#include <featureCache.h>
+#include <panorama.h>
+#include <videoStitching.h>
+#include <tiledStitching.h>
+#include <pipelineContext.h>
+#include <coarseToFine.h>
+#include <batchStitching.h>
+#include <profiler.h>
 #include <matplot/matplot.h>
 
 
 
-int main()
+// Stitch an ordered list of images into one panorama: OpenCV_Project --panorama <image>...
+static int runPanorama(const std::vector<std::string> &paths)
 {
+    PanoramaResult result = stitchPanorama(paths);
+    cv::imwrite("../outputs/panorama.jpg", result.panorama);
+
+    std::cout << "stage\ttasks\twall ms\tbusy ms\tmax queue\tmean queue" << std::endl;
+    for (const auto &stage : result.stages)
+    {
+        std::cout << stage.stage << "\t" << stage.numTasks << "\t" << stage.wallTimeMs << "\t" << stage.busyTimeMs << "\t"
+                  << stage.maxQueueDepth << "\t" << stage.meanQueueDepth << std::endl;
+    }
+    if (result.adjustment.numCorrespondences > 0)
+    {
+        std::cout << "iteration\trms px\tlambda\trejected\tms" << std::endl;
+        for (size_t i = 0; i < result.adjustment.iterations.size(); ++i)
+        {
+            const BundleAdjustmentIteration &iteration = result.adjustment.iterations[i];
+            std::cout << i + 1 << "\t" << iteration.rmsError << "\t" << iteration.lambda << "\t" << iteration.rejectedSteps << "\t" << iteration.timeMs << std::endl;
+        }
+        std::cout << "bundle adjustment: " << result.adjustment.initialRmsError << " -> " << result.adjustment.finalRmsError << " px rms over "
+                  << result.adjustment.numCorrespondences << " correspondences, " << result.adjustment.totalTimeMs << " ms" << std::endl;
+    }
+    std::cout << "total: " << result.totalTimeMs << " ms" << std::endl;
+    return 0;
+}
+
+// Stitch two synchronized videos: OpenCV_Project --video <left> <right> [output]
+static int runVideo(const std::string &path1, const std::string &path2, const std::string &outputPath)
+{
+    StreamingStats stats = stitchVideoFiles(path1, path2, outputPath);
+    std::cout << "frames: " << stats.numFrames << ", re-detections: " << stats.numRedetections
+              << ", warp plan rebuilds: " << stats.numPlanRebuilds << std::endl;
+    std::cout << "latency p50 / p90 / p99 / max ms: " << stats.latencyP50Ms << " / " << stats.latencyP90Ms << " / "
+              << stats.latencyP99Ms << " / " << stats.latencyMaxMs << std::endl;
+    std::cout << "sustained fps: " << stats.sustainedFps << std::endl;
+    return 0;
+}
+
+// Stitch a pair into a directory of tiles without allocating the full canvas:
+// OpenCV_Project --tiled <image1> <image2> <output directory>
+static int runTiled(const std::string &path1, const std::string &path2, const std::string &outputDirectory)
+{
+    cv::Mat image1 = load_image(path1);
+    cv::Mat image2 = load_image(path2);
+    // Inputs of the tiled mode are large, so detection is tiled across cores as well
+    ExtractionOptions extraction;
+    extraction.tiled = true;
+    FeatureSet features1 = extract_feature_set(image1, FeatureDetectorMethod::SIFT, extraction);
+    FeatureSet features2 = extract_feature_set(image2, FeatureDetectorMethod::SIFT, extraction);
+    MatchSet matches = match_feature_sets(features2, features1);
+    HomographyEstimation homography = estimateHomography(features2, features1, matches, 5.0);
+
+    TiledStitchingResult result = stitchImagesTiled(image1, image2, homography.H, outputDirectory);
+    std::cout << "panorama " << result.bounds.width << "x" << result.bounds.height << " in " << result.tilesX << "x" << result.tilesY
+              << " tiles, peak tile memory " << result.peakTileBytes / (1024.0 * 1024.0) << " MiB, " << result.timeMs << " ms" << std::endl;
+    return 0;
+}
+
+// Stitch every pair of a manifest in parallel:
+// OpenCV_Project --batch <directory | glob | jobs.csv | jobs.json> [output directory] [--workers N] [--force]
+static int runBatchManifest(const std::vector<std::string> &args)
+{
+    std::string manifest;
+    BatchOptions options;
+    bool outputGiven = false;
+    for (size_t i = 0; i < args.size(); ++i)
+    {
+        if (args[i] == "--force")
+            options.force = true;
+        else if (args[i] == "--workers" && i + 1 < args.size())
+            options.numWorkers = static_cast<unsigned>(std::stoul(args[++i]));
+        else if (manifest.empty())
+            manifest = args[i];
+        else if (!outputGiven)
+        {
+            options.outputDirectory = args[i];
+            outputGiven = true;
+        }
+    }
+    if (manifest.empty())
+    {
+        std::cerr << "usage: --batch <directory | glob | jobs.csv | jobs.json> [output directory] [--workers N] [--force]" << std::endl;
+        return 1;
+    }
+
+    BatchStats stats = runBatch(loadManifest(manifest), options);
+    for (const auto &job : stats.jobs)
+    {
+        if (job.failed)
+            std::cerr << "failed: " << job.output << ": " << job.error << std::endl;
+    }
+    std::cout << "stage\ttasks\twall ms\tbusy ms\tmax queue\tmean queue" << std::endl;
+    for (const auto &stage : stats.stages)
+    {
+        std::cout << stage.stage << "\t" << stage.numTasks << "\t" << stage.wallTimeMs << "\t" << stage.busyTimeMs << "\t"
+                  << stage.maxQueueDepth << "\t" << stage.meanQueueDepth << std::endl;
+    }
+    std::cout << "jobs: " << stats.numJobs << ", stitched: " << stats.numProcessed << ", skipped: " << stats.numSkipped
+              << ", failed: " << stats.numFailed << std::endl;
+    std::cout << "total: " << stats.wallTimeMs << " ms, " << stats.pairsPerSecond << " pairs/s" << std::endl;
+    return stats.numFailed > 0 ? 1 : 0;
+}
+
+// Values of a profiler metric recorded under a label, e.g. profiled("inliers", "pair1/sift/t5")
+static std::vector<double> profiled(const std::string &metric, const std::string &label)
+{
+    return Profiler::instance().metricValues(metric, label);
+}
+
+// The single value of a metric under a label that holds exactly one estimate
+static double profiledValue(const std::string &metric, const std::string &label)
+{
+    std::vector<double> values = profiled(metric, label);
+    if (values.size() != 1)
+    {
+        throw std::runtime_error("Expected one " + metric + " value under " + label + ", found " + std::to_string(values.size()));
+    }
+    return values[0];
+}
+
+// One value per threshold for a pair's SIFT estimates: findHomography at 1.0, 5.0 and 10.0, then the PROSAC sweep
+static std::vector<double> profiledByThreshold(const std::string &metric, const std::string &pair)
+{
+    std::vector<double> values = {profiledValue(metric, pair + "/sift/t1"), profiledValue(metric, pair + "/sift/t5"),
+                                  profiledValue(metric, pair + "/sift/t10")};
+    std::vector<double> sweep = profiled(metric, pair + "/sift/prosac");
+    if (sweep.size() != 3)
+    {
+        throw std::runtime_error("Expected three " + metric + " values under " + pair + "/sift/prosac, found " + std::to_string(sweep.size()));
+    }
+    values.insert(values.end(), sweep.begin(), sweep.end());
+    return values;
+}
+
+static double profiledSum(const std::string &metric, const std::string &label)
+{
+    double sum = 0.0;
+    for (double value : profiled(metric, label))
+    {
+        sum += value;
+    }
+    return sum;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1 && std::string(argv[1]) == "--panorama")
+    {
+        return runPanorama(std::vector<std::string>(argv + 2, argv + argc));
+    }
+    if (argc > 3 && std::string(argv[1]) == "--video")
+    {
+        return runVideo(argv[2], argv[3], argc > 4 ? argv[4] : "");
+    }
+    if (argc > 4 && std::string(argv[1]) == "--tiled")
+    {
+        return runTiled(argv[2], argv[3], argv[4]);
+    }
+    if (argc > 1 && std::string(argv[1]) == "--batch")
+    {
+        return runBatchManifest(std::vector<std::string>(argv + 2, argv + argc));
+    }
+
     ImageFeatures features1_1, features1_2, features2_1, features2_2, features3_1, features3_2;
     ImageFeatures features1_1_orb, features1_2_orb, features2_1_orb, features2_2_orb, features3_1_orb, features3_2_orb;
     cv::Mat image1_1, image1_2, image2_1, image2_2, image3_1, image3_2;
 
+    // Every stage records spans and metrics; labels tag them with the pair and method they belong to
+    Profiler &profiler = Profiler::instance();
+    profiler.trackMatAllocations(true);
+
     // Load images
     image1_1 = load_image("../images/1_1.jpg");
     image1_2 = load_image("../images/1_2.jpg");
@@ -20,25 +196,37 @@ int main()
     image3_1 = load_image("../images/3_1.jpg");
     image3_2 = load_image("../images/3_2.jpg");
 
+    // Features are cached on disk by image content, so repeated runs skip detection
+    FeatureCache featureCache("../cache/features");
+    // Keypoint images are written below, so ask for them; other callers skip the full-size copy
+    ExtractionOptions withKeypointImages;
+    withKeypointImages.drawKeypoints = true;
+
     // Do feature extraction using SIFT
-    features1_1 = extract_features(image1_1);
-    features1_2 = extract_features(image1_2);
+    profiler.setLabel("pair1/sift");
+    features1_1 = extract_features_cached(featureCache, image1_1, FeatureDetectorMethod::SIFT, withKeypointImages);
+    features1_2 = extract_features_cached(featureCache, image1_2, FeatureDetectorMethod::SIFT, withKeypointImages);
 
-    features2_1 = extract_features(image2_1);
-    features2_2 = extract_features(image2_2);
+    profiler.setLabel("pair2/sift");
+    features2_1 = extract_features_cached(featureCache, image2_1, FeatureDetectorMethod::SIFT, withKeypointImages);
+    features2_2 = extract_features_cached(featureCache, image2_2, FeatureDetectorMethod::SIFT, withKeypointImages);
 
-    features3_1 = extract_features(image3_1);
-    features3_2 = extract_features(image3_2);
+    profiler.setLabel("pair3/sift");
+    features3_1 = extract_features_cached(featureCache, image3_1, FeatureDetectorMethod::SIFT, withKeypointImages);
+    features3_2 = extract_features_cached(featureCache, image3_2, FeatureDetectorMethod::SIFT, withKeypointImages);
 
     // Do feature extraction using ORB
-    features1_1_orb = extract_features(image1_1, FeatureDetectorMethod::ORB);
-    features1_2_orb = extract_features(image1_2, FeatureDetectorMethod::ORB);
+    profiler.setLabel("pair1/orb");
+    features1_1_orb = extract_features_cached(featureCache, image1_1, FeatureDetectorMethod::ORB, withKeypointImages);
+    features1_2_orb = extract_features_cached(featureCache, image1_2, FeatureDetectorMethod::ORB, withKeypointImages);
 
-    features2_1_orb = extract_features(image2_1, FeatureDetectorMethod::ORB);
-    features2_2_orb = extract_features(image2_2, FeatureDetectorMethod::ORB);
+    profiler.setLabel("pair2/orb");
+    features2_1_orb = extract_features_cached(featureCache, image2_1, FeatureDetectorMethod::ORB, withKeypointImages);
+    features2_2_orb = extract_features_cached(featureCache, image2_2, FeatureDetectorMethod::ORB, withKeypointImages);
 
-    features3_1_orb = extract_features(image3_1, FeatureDetectorMethod::ORB);
-    features3_2_orb = extract_features(image3_2, FeatureDetectorMethod::ORB);
+    profiler.setLabel("pair3/orb");
+    features3_1_orb = extract_features_cached(featureCache, image3_1, FeatureDetectorMethod::ORB, withKeypointImages);
+    features3_2_orb = extract_features_cached(featureCache, image3_2, FeatureDetectorMethod::ORB, withKeypointImages);
     
     // Save images with keypoints drawn
     cv::imwrite("../outputs/image1_1_keypoints.jpg", features1_1.imageWithKeypoints);
@@ -60,35 +248,40 @@ int main()
     cv::imwrite("../outputs/image3_2_keypoints_orb.jpg", features3_2_orb.imageWithKeypoints);
 
     // Plot bar chart of #keypoint per image (pair) by extraction method
-    double numKeypoints1 = features1_1.keypoints.size() + features1_2.keypoints.size();
-    double numKeypoints2 = features2_1.keypoints.size() + features2_2.keypoints.size();
-    double numKeypoints3 = features3_1.keypoints.size() + features3_2.keypoints.size();
-
-    double numKeypoints1_orb = features1_1_orb.keypoints.size() + features1_2_orb.keypoints.size();
-    double numKeypoints2_orb = features2_1_orb.keypoints.size() + features2_2_orb.keypoints.size();
-    double numKeypoints3_orb = features3_1_orb.keypoints.size() + features3_2_orb.keypoints.size();
-
-    std::vector<std::vector<double>> numKeypointByMethod = {{numKeypoints1, numKeypoints1_orb}, {numKeypoints2, numKeypoints2_orb}, {numKeypoints3, numKeypoints3_orb}};
+    std::vector<std::vector<double>> numKeypointByMethod = {{profiledSum("keypoints", "pair1/sift"), profiledSum("keypoints", "pair1/orb")},
+                                                            {profiledSum("keypoints", "pair2/sift"), profiledSum("keypoints", "pair2/orb")},
+                                                            {profiledSum("keypoints", "pair3/sift"), profiledSum("keypoints", "pair3/orb")}};
     matplot::bar(numKeypointByMethod);
     matplot::ylabel("# Keypoints");
     matplot::gca()->x_axis().ticklabels({"SIFT", "ORB"});
     matplot::title("Number of Keypoints Detected by Feature Extraction Method");
     matplot::save("../plots/num_keypoints.jpg");
 
-    // Match features using BFMatcher
+    // Match features, using a KD-tree index for SIFT and the SIMD Hamming matcher for ORB
+    profiler.setLabel("pair1/sift");
     FeatureMatches matches1 = match_features(features1_2, features1_1);
+    profiler.setLabel("pair2/sift");
     FeatureMatches matches2 = match_features(features2_2, features2_1);
+    profiler.setLabel("pair3/sift");
     FeatureMatches matches3 = match_features(features3_2, features3_1);
 
+    profiler.setLabel("pair1/orb");
     FeatureMatches matches1_orb = match_features(features1_2_orb, features1_1_orb);
+    profiler.setLabel("pair2/orb");
     FeatureMatches matches2_orb = match_features(features2_2_orb, features2_1_orb);
+    profiler.setLabel("pair3/orb");
     FeatureMatches matches3_orb = match_features(features3_2_orb, features3_1_orb);
 
-    // Plot bar chart of matching time per image (pair) by extraction method
-    std::vector<std::vector<double>> matchingTimeByMethod = {{matches1.matchingTimeMs, matches1_orb.matchingTimeMs}, {matches2.matchingTimeMs, matches2_orb.matchingTimeMs}, {matches3.matchingTimeMs, matches3_orb.matchingTimeMs}};
+    // Plot bar chart of matching time per image (pair) by extraction method, split into index build and query time
+    std::vector<std::vector<double>> matchingTimeByMethod;
+    for (const std::string pair : {"pair1", "pair2", "pair3"})
+    {
+        matchingTimeByMethod.push_back({profiledSum("index_build_ms", pair + "/sift"), profiledSum("query_ms", pair + "/sift"),
+                                        profiledSum("index_build_ms", pair + "/orb"), profiledSum("query_ms", pair + "/orb")});
+    }
     matplot::bar(matchingTimeByMethod);
     matplot::ylabel("Matching Time (ms)");
-    matplot::gca()->x_axis().ticklabels({"SIFT", "ORB"});
+    matplot::gca()->x_axis().ticklabels({"SIFT index", "SIFT query", "ORB index", "ORB query"});
     matplot::title("Feature Matching Time by Extraction Method");
     matplot::save("../plots/matching_time.jpg");
 
@@ -119,39 +312,61 @@ int main()
     matplot::save("../plots/match_distances.jpg");
 
     // Estimate homography for each image pair, with varying reprojection thresholds
+    profiler.setLabel("pair1/sift/t1");
     HomographyEstimation homography1_1 = estimateHomography(features1_2.keypoints, features1_1.keypoints, matches1, 1.0);
-    HomographyEstimation homography2_1 = estimateHomography(features2_2.keypoints, features2_1.keypoints, matches2, 1.0);
-    HomographyEstimation homography3_1 = estimateHomography(features3_2.keypoints, features3_1.keypoints, matches3, 1.0);
-
+    profiler.setLabel("pair1/sift/t5");
     HomographyEstimation homography1_5 = estimateHomography(features1_2.keypoints, features1_1.keypoints, matches1, 5.0);
-    HomographyEstimation homography2_5 = estimateHomography(features2_2.keypoints, features2_1.keypoints, matches2, 5.0);
-    HomographyEstimation homography3_5 = estimateHomography(features3_2.keypoints, features3_1.keypoints, matches3, 5.0);
-
+    profiler.setLabel("pair1/sift/t10");
     HomographyEstimation homography1_10 = estimateHomography(features1_2.keypoints, features1_1.keypoints, matches1, 10.0);
+
+    profiler.setLabel("pair2/sift/t1");
+    HomographyEstimation homography2_1 = estimateHomography(features2_2.keypoints, features2_1.keypoints, matches2, 1.0);
+    profiler.setLabel("pair2/sift/t5");
+    HomographyEstimation homography2_5 = estimateHomography(features2_2.keypoints, features2_1.keypoints, matches2, 5.0);
+    profiler.setLabel("pair2/sift/t10");
     HomographyEstimation homography2_10 = estimateHomography(features2_2.keypoints, features2_1.keypoints, matches2, 10.0);
+
+    profiler.setLabel("pair3/sift/t1");
+    HomographyEstimation homography3_1 = estimateHomography(features3_2.keypoints, features3_1.keypoints, matches3, 1.0);
+    profiler.setLabel("pair3/sift/t5");
+    HomographyEstimation homography3_5 = estimateHomography(features3_2.keypoints, features3_1.keypoints, matches3, 5.0);
+    profiler.setLabel("pair3/sift/t10");
     HomographyEstimation homography3_10 = estimateHomography(features3_2.keypoints, features3_1.keypoints, matches3, 10.0);
 
+    // Same thresholds with the parallel PROSAC/SPRT estimator, one shared RANSAC run per pair for all thresholds.
+    // Every findHomography estimate has its own label; the sweep records its three thresholds in order under one.
+    const std::vector<float> thresholds = {1.0f, 5.0f, 10.0f};
+    profiler.setLabel("pair1/sift/prosac");
+    std::vector<HomographyEstimation> sweep1 = estimateHomographySweep(features1_2.keypoints, features1_1.keypoints, matches1, thresholds);
+    profiler.setLabel("pair2/sift/prosac");
+    std::vector<HomographyEstimation> sweep2 = estimateHomographySweep(features2_2.keypoints, features2_1.keypoints, matches2, thresholds);
+    profiler.setLabel("pair3/sift/prosac");
+    std::vector<HomographyEstimation> sweep3 = estimateHomographySweep(features3_2.keypoints, features3_1.keypoints, matches3, thresholds);
+
+    std::cout << "PROSAC iterations (time per iteration) at threshold 5.0: "
+              << sweep1[1].iterations << " (" << sweep1[1].timePerIterationUs << " us), "
+              << sweep2[1].iterations << " (" << sweep2[1].timePerIterationUs << " us), "
+              << sweep3[1].iterations << " (" << sweep3[1].timePerIterationUs << " us)" << std::endl;
+
     // Plot bar char of numbers of inliers by reprojection threshold for each image pair for each threshold
-    std::vector<std::vector<int>> numInliersByThreshold = {{homography1_1.numInliers, homography1_5.numInliers, homography1_10.numInliers}, 
-                                                            {homography2_1.numInliers, homography2_5.numInliers, homography2_10.numInliers}, 
-                                                            {homography3_1.numInliers, homography3_5.numInliers, homography3_10.numInliers}};
+    std::vector<std::vector<double>> numInliersByThreshold = {profiledByThreshold("inliers", "pair1"), profiledByThreshold("inliers", "pair2"),
+                                                              profiledByThreshold("inliers", "pair3")};
     matplot::figure();
     matplot::bar(numInliersByThreshold);
     matplot::ylabel("# Inliers");
     matplot::xlabel("Reprojection Threshold");
-    matplot::gca()->x_axis().ticklabels({"1.0", "5.0", "10.0"});
+    matplot::gca()->x_axis().ticklabels({"1.0", "5.0", "10.0", "1.0 PROSAC", "5.0 PROSAC", "10.0 PROSAC"});
     matplot::title("Number of Inliers by Reprojection Threshold");
     matplot::save("../plots/num_inliers.jpg");
 
     // Plot bar chart of estimation time by reprojection threshold for each image pair for each threshold
-    std::vector<std::vector<double>> estimationTimeByThreshold = {{homography1_1.estimationTimeMs, homography1_5.estimationTimeMs, homography1_10.estimationTimeMs}, 
-                                                                  {homography2_1.estimationTimeMs, homography2_5.estimationTimeMs, homography2_10.estimationTimeMs}, 
-                                                                  {homography3_1.estimationTimeMs, homography3_5.estimationTimeMs, homography3_10.estimationTimeMs}};
+    std::vector<std::vector<double>> estimationTimeByThreshold = {profiledByThreshold("estimation_ms", "pair1"), profiledByThreshold("estimation_ms", "pair2"),
+                                                                  profiledByThreshold("estimation_ms", "pair3")};
     matplot::figure();
     matplot::bar(estimationTimeByThreshold);
     matplot::ylabel("Estimation Time (ms)");
     matplot::xlabel("Reprojection Threshold");
-    matplot::gca()->x_axis().ticklabels({"1.0", "5.0", "10.0"});
+    matplot::gca()->x_axis().ticklabels({"1.0", "5.0", "10.0", "1.0 PROSAC", "5.0 PROSAC", "10.0 PROSAC"});
     matplot::title("Homography Estimation Time by Reprojection Threshold");
     matplot::save("../plots/estimation_time.jpg");
 
@@ -181,9 +396,13 @@ int main()
     cv::imwrite("../outputs/stitched3_sift_threshold10.jpg", stitched3_10);
 
     // Export one sample for stiching using ORB features
+    profiler.setLabel("pair1/orb/t1");
     HomographyEstimation homography1_1_orb = estimateHomography(features1_2_orb.keypoints, features1_1_orb.keypoints, matches1_orb, 1.0);
+    profiler.setLabel("pair2/orb/t1");
     HomographyEstimation homography2_1_orb = estimateHomography(features2_2_orb.keypoints, features2_1_orb.keypoints, matches2_orb, 1.0);
+    profiler.setLabel("pair3/orb/t1");
     HomographyEstimation homography3_1_orb = estimateHomography(features3_2_orb.keypoints, features3_1_orb.keypoints, matches3_orb, 1.0);
+    profiler.setLabel("");
 
     cv::Mat stitched1_1_orb = stitchImages(image1_1, image1_2, homography1_1_orb.H);
     cv::Mat stitched2_1_orb = stitchImages(image2_1, image2_2, homography2_1_orb.H);
@@ -210,10 +429,28 @@ int main()
     cv::imwrite("../outputs/stitched2_sift_threshold5_feathered.jpg", stiched_2_5_feathered);
     cv::imwrite("../outputs/stitched3_sift_threshold5_feathered.jpg", stiched_3_5_feathered);
 
+    // Export the same pairs with multi-band blending, which avoids the ghosting of the linear ramp
+    cv::imwrite("../outputs/stitched1_sift_threshold5_multiband.jpg", stitchImages(image1_1, image1_2, homography1_5.H, StitchingMethod::MULTIBAND));
+    cv::imwrite("../outputs/stitched2_sift_threshold5_multiband.jpg", stitchImages(image2_1, image2_2, homography2_5.H, StitchingMethod::MULTIBAND));
+    cv::imwrite("../outputs/stitched3_sift_threshold5_multiband.jpg", stitchImages(image3_1, image3_2, homography3_5.H, StitchingMethod::MULTIBAND));
+
+    // Compare the vectorized feathering path against the legacy per-pixel implementation
+    StitchingTimings featherTimings, legacyTimings;
+    cv::Mat featheredFast = stitchImages(image1_1, image1_2, homography1_1.H, StitchingMethod::FEATHERING, &featherTimings);
+    cv::Mat featheredLegacy = stitchImages(image1_1, image1_2, homography1_1.H, StitchingMethod::FEATHERING_LEGACY, &legacyTimings);
+    bool identical = cv::norm(featheredFast, featheredLegacy, cv::NORM_INF) == 0;
+    std::cout << "Feathering (warp / overlap / blend ms): "
+              << featherTimings.warpTimeMs << " / " << featherTimings.overlapTimeMs << " / " << featherTimings.blendTimeMs
+              << ", legacy: "
+              << legacyTimings.warpTimeMs << " / " << legacyTimings.overlapTimeMs << " / " << legacyTimings.blendTimeMs
+              << ", identical: " << (identical ? "yes" : "no") << std::endl;
+
     // Plot alignment error by sift vs. orb (constant threshold)
-    std::vector<std::vector<float>> alignmentErrorByMethod = {{homography1_1.alignmentError, homography1_1_orb.alignmentError}, 
-                                                              {homography2_1.alignmentError, homography2_1_orb.alignmentError}, 
-                                                              {homography3_1.alignmentError, homography3_1_orb.alignmentError}};
+    std::vector<std::vector<double>> alignmentErrorByMethod;
+    for (const std::string pair : {"pair1", "pair2", "pair3"})
+    {
+        alignmentErrorByMethod.push_back({profiledValue("alignment_error", pair + "/sift/t1"), profiledValue("alignment_error", pair + "/orb/t1")});
+    }
     matplot::figure();
     matplot::bar(alignmentErrorByMethod);
     matplot::ylabel("Average Alignment Error");
@@ -224,7 +461,8 @@ int main()
  
 
     // Plot alignment error by threshold (for SIFT)
-    std::vector<float> alignmentErrorByThreshold = {homography1_1.alignmentError, homography1_5.alignmentError, homography1_10.alignmentError};
+    std::vector<double> alignmentErrorByThreshold = {profiledValue("alignment_error", "pair1/sift/t1"), profiledValue("alignment_error", "pair1/sift/t5"),
+                                                     profiledValue("alignment_error", "pair1/sift/t10")};
     matplot::figure();
     matplot::bar(alignmentErrorByThreshold);
     matplot::ylabel("Average Alignment Error");
@@ -233,5 +471,61 @@ int main()
     matplot::title("Alignment Error by Reprojection Threshold (Feature Extraction Method=SIFT)");
     matplot::save("../plots/threshold_alignment_error.jpg");
 
+    // Coarse-to-fine estimate of every pair against the full-resolution findHomography estimate at threshold 5.0.
+    // Features above came from the cache, so only the accuracy is compared here; stitching_benchmark times both paths.
+    const HomographyEstimation *fullResolution[] = {&homography1_5, &homography2_5, &homography3_5};
+    const cv::Mat *coarsePairs[][2] = {{&image1_1, &image1_2}, {&image2_1, &image2_2}, {&image3_1, &image3_2}};
+    for (int p = 0; p < 3; ++p)
+    {
+        profiler.setLabel("pair" + std::to_string(p + 1) + "/coarse_to_fine");
+        HomographyEstimation coarseToFine = estimateHomographyCoarseToFine(*coarsePairs[p][0], *coarsePairs[p][1]);
+        std::cout << "Coarse-to-fine pair " << p + 1 << ": " << coarseToFine.estimationTimeMs << " ms, alignment error " << coarseToFine.alignmentError
+                  << " (full resolution " << fullResolution[p]->alignmentError << "), " << coarseToFine.numInliers << " inliers (full resolution "
+                  << fullResolution[p]->numInliers << ")" << std::endl;
+    }
+    profiler.setLabel("");
+
+    // Steady state: the three pairs twice through one reused context. Its buffers grow to the largest pair
+    // during the first round; afterwards the cv::Mat count should stay near zero. The heap count also sees
+    // OpenCV's internal temporaries, the rebuilt KD-tree and the profiler's records, so it levels off instead.
+    PipelineContext context;
+    profiler.trackHeapAllocations(true);
+    const cv::Mat *pairs[][2] = {{&image1_1, &image1_2}, {&image2_1, &image2_2}, {&image3_1, &image3_2}};
+    for (int round = 0; round < 2; ++round)
+    {
+        for (int p = 0; p < 3; ++p)
+        {
+            profiler.setLabel("pair" + std::to_string(p + 1) + "/context");
+            stitchPair(context, *pairs[p][0], *pairs[p][1]);
+            std::cout << "round " << round + 1 << ", pair " << p + 1 << ": " << context.stats.lastPairMatAllocations << " cv::Mat allocations, "
+                      << context.stats.lastPairMatAllocatedBytes / (1024.0 * 1024.0) << " MiB";
+            if (profiler.heapTrackingAvailable())
+            {
+                std::cout << "; " << context.stats.lastPairHeapAllocations << " operator new calls, "
+                          << context.stats.lastPairHeapAllocatedBytes / (1024.0 * 1024.0) << " MiB";
+            }
+            std::cout << std::endl;
+        }
+    }
+    profiler.trackHeapAllocations(false);
+    profiler.setLabel("");
+    if (!profiler.heapTrackingAvailable())
+    {
+        std::cout << "operator new calls are not counted, configure with -DSTITCHING_COUNT_HEAP_ALLOCATIONS=ON" << std::endl;
+    }
+    std::cout << "Pipeline context: " << context.stats.pairs << " pairs, peak RSS " << context.stats.peakRssBytes / (1024.0 * 1024.0) << " MiB" << std::endl;
+
+    FeatureCacheStats cacheStats = featureCache.stats();
+    std::cout << "Feature cache: " << cacheStats.hits << " hits, " << cacheStats.misses << " misses, "
+              << cacheStats.evictions << " evictions, " << cacheStats.sizeBytes << " bytes" << std::endl;
+
+    // Per-run profile: summary as JSON and CSV, every span as a Chrome trace
+    profiler.writeJson("../outputs/profile.json");
+    profiler.writeCsv("../outputs/profile.csv");
+    profiler.writeChromeTrace("../outputs/trace.json");
+    AllocationStats allocations = profiler.allocationStats();
+    std::cout << "cv::Mat allocations: " << allocations.allocations << ", " << allocations.allocatedBytes / (1024.0 * 1024.0)
+              << " MiB total, " << allocations.peakLiveBytes / (1024.0 * 1024.0) << " MiB peak live" << std::endl;
+
     return 0;
 }
\ No newline at end of file
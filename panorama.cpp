@@ -0,0 +1,233 @@
+#include <opencv2/opencv.hpp>
+#include <panorama.h>
+#include <warping.h>
+#include <bundleAdjustment.h>
+
+namespace
+{
+// Two matched images, i < j; the homography maps image j onto image i
+struct MatchedPair
+{
+    int i, j;
+    FeatureMatches matches;
+    HomographyEstimation homography;
+};
+}
+
+// Pairs beyond the neighbour with fewer inliers than this are left out of the adjustment, their images may not overlap
+static const int MIN_ADJUSTMENT_INLIERS = 30;
+
+// Matches of a pair that its homography maps within the threshold, as correspondences between image i and image j
+static PairCorrespondences inlierCorrespondences(const MatchedPair &pair, const std::vector<ImageFeatures> &features, float threshold)
+{
+    PairCorrespondences correspondences{pair.i, pair.j, {}, {}};
+    if (pair.homography.H.empty())
+        return correspondences;
+
+    const cv::Matx33d H = pair.homography.H;
+    for (const auto &match : pair.matches.matches)
+    {
+        const cv::Point2f &p = features[pair.j].keypoints[match.queryIdx].pt;
+        const cv::Point2f &q = features[pair.i].keypoints[match.trainIdx].pt;
+        const cv::Vec3d mapped = H * cv::Vec3d(p.x, p.y, 1.0);
+        if (mapped[2] <= 1e-9)
+            continue;
+        const double dx = mapped[0] / mapped[2] - q.x, dy = mapped[1] / mapped[2] - q.y;
+        if (dx * dx + dy * dy < threshold * threshold)
+        {
+            correspondences.points1.push_back(q);
+            correspondences.points2.push_back(p);
+        }
+    }
+    return correspondences;
+}
+
+// Chain the homographies of neighbouring images (image i + 1 -> image i) into transforms relative to image 0,
+// bundle-adjust them over all matched pairs and shift them so the whole panorama lands in positive coordinates
+static std::vector<cv::Mat> alignGlobally(const std::vector<cv::Mat> &images, const std::vector<ImageFeatures> &features, const std::vector<MatchedPair> &pairs,
+                                          const PanoramaOptions &options, cv::Size &canvasSize, BundleAdjustmentResult &adjustment)
+{
+    const int n = static_cast<int>(images.size());
+    std::vector<cv::Mat> transforms(n);
+    transforms[0] = cv::Mat::eye(3, 3, CV_64F);
+    // Pairs are ordered by their first image, so transforms[pair.i] is known when its neighbour is reached
+    for (const auto &pair : pairs)
+    {
+        if (pair.j != pair.i + 1)
+            continue;
+        if (pair.homography.H.empty())
+        {
+            throw std::runtime_error("Could not estimate homography between image " + std::to_string(pair.i) + " and " + std::to_string(pair.j));
+        }
+        transforms[pair.j] = transforms[pair.i] * pair.homography.H;
+    }
+
+    if (options.bundleAdjustment)
+    {
+        std::vector<PairCorrespondences> correspondences;
+        for (const auto &pair : pairs)
+        {
+            PairCorrespondences inliers = inlierCorrespondences(pair, features, options.threshold);
+            // Neighbours always take part, they are what holds the chain together
+            if (pair.j == pair.i + 1 || static_cast<int>(inliers.points1.size()) >= MIN_ADJUSTMENT_INLIERS)
+                correspondences.push_back(std::move(inliers));
+        }
+        adjustment = bundleAdjustHomographies(transforms, correspondences, options.bundleAdjustmentOptions);
+        for (int i = 0; i < n; ++i)
+        {
+            transforms[i] = adjustment.transforms[i].clone();
+        }
+    }
+
+    std::vector<cv::Point2f> corners;
+    double inputArea = 0.0;
+    for (int i = 0; i < n; ++i)
+    {
+        const float w = static_cast<float>(images[i].cols), h = static_cast<float>(images[i].rows);
+        std::vector<cv::Point2f> imageCorners = {{0, 0}, {w, 0}, {w, h}, {0, h}}, projected;
+        cv::perspectiveTransform(imageCorners, projected, transforms[i]);
+        corners.insert(corners.end(), projected.begin(), projected.end());
+        inputArea += w * h;
+    }
+
+    float minX = corners[0].x, minY = corners[0].y, maxX = corners[0].x, maxY = corners[0].y;
+    for (const auto &corner : corners)
+    {
+        minX = std::min(minX, corner.x);
+        minY = std::min(minY, corner.y);
+        maxX = std::max(maxX, corner.x);
+        maxY = std::max(maxY, corner.y);
+    }
+    canvasSize = cv::Size(static_cast<int>(std::ceil(maxX - std::floor(minX))), static_cast<int>(std::ceil(maxY - std::floor(minY))));
+    // A near-singular homography projects corners towards infinity
+    if (canvasSize.width <= 0 || canvasSize.height <= 0 || static_cast<double>(canvasSize.area()) > 16.0 * inputArea)
+    {
+        throw std::runtime_error("Degenerate panorama alignment, canvas would be " + std::to_string(canvasSize.width) + "x" + std::to_string(canvasSize.height));
+    }
+
+    cv::Mat shift = (cv::Mat_<double>(3, 3) << 1, 0, -std::floor(minX), 0, 1, -std::floor(minY), 0, 0, 1);
+    for (auto &transform : transforms)
+    {
+        transform = shift * transform;
+    }
+    return transforms;
+}
+
+// Warp one image onto the canvas together with a blend weight that grows with the distance to its border
+static void warpIntoCanvas(const cv::Mat &image, const cv::Mat &transform, cv::Size canvasSize, cv::Mat &warped, cv::Mat &weight)
+{
+    cv::warpPerspective(image, warped, transform, canvasSize);
+
+    cv::Mat mask;
+    cv::warpPerspective(cv::Mat(image.size(), CV_8U, cv::Scalar(255)), mask, transform, canvasSize, cv::INTER_NEAREST);
+    cv::distanceTransform(mask, weight, cv::DIST_L2, 3);
+}
+
+// Weighted average of all warped images, the N-image generalization of feathering
+static cv::Mat blendWeighted(const std::vector<cv::Mat> &warped, const std::vector<cv::Mat> &weights)
+{
+    const cv::Size size = warped[0].size();
+    cv::Mat blended(size, CV_8UC3);
+
+    cv::parallel_for_(cv::Range(0, size.height), [&](const cv::Range &range)
+    {
+        for (int y = range.start; y < range.end; ++y)
+        {
+            uchar *out = blended.ptr<uchar>(y);
+            for (int x = 0; x < size.width; ++x)
+            {
+                float sum[3] = {0.0f, 0.0f, 0.0f};
+                float weightSum = 0.0f;
+                for (size_t i = 0; i < warped.size(); ++i)
+                {
+                    const float w = weights[i].ptr<float>(y)[x];
+                    if (w <= 0.0f)
+                        continue;
+                    const uchar *pixel = warped[i].ptr<uchar>(y) + 3 * x;
+                    sum[0] += w * pixel[0];
+                    sum[1] += w * pixel[1];
+                    sum[2] += w * pixel[2];
+                    weightSum += w;
+                }
+                for (int c = 0; c < 3; ++c)
+                {
+                    out[3 * x + c] = weightSum > 0.0f ? cv::saturate_cast<uchar>(sum[c] / weightSum) : 0;
+                }
+            }
+        }
+    });
+    return blended;
+}
+
+PanoramaResult stitchPanorama(const std::vector<std::string> &paths, const PanoramaOptions &options)
+{
+    const int n = static_cast<int>(paths.size());
+    if (n < 2)
+    {
+        throw std::invalid_argument("A panorama needs at least two images");
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+
+    std::vector<cv::Mat> images(n), warped(n), weights(n);
+    std::vector<ImageFeatures> features(n);
+    std::vector<MatchedPair> pairs;
+    PanoramaResult result;
+    cv::Size canvasSize;
+
+    // Without the adjustment only neighbours are needed
+    const int span = options.bundleAdjustment ? std::max(1, options.matchSpan) : 1;
+    for (int i = 0; i < n; ++i)
+    {
+        for (int j = i + 1; j < n && j <= i + span; ++j)
+        {
+            pairs.push_back(MatchedPair{i, j, {}, {}});
+        }
+    }
+
+    TaskGraph graph;
+    std::vector<int> extractTasks(n), estimateTasks(pairs.size()), warpTasks(n);
+    for (int i = 0; i < n; ++i)
+    {
+        int load = graph.add("load", [&, i] { images[i] = load_image(paths[i]); });
+        extractTasks[i] = graph.add("extract", [&, i] { features[i] = extract_features(images[i], options.method); }, {load});
+    }
+    for (size_t k = 0; k < pairs.size(); ++k)
+    {
+        // Same direction as the pairwise pipeline: H maps image j onto image i
+        int match = graph.add("match", [&, k] {
+            MatchedPair &pair = pairs[k];
+            pair.matches = match_features(features[pair.j], features[pair.i], options.matchOptions);
+        }, {extractTasks[pairs[k].i], extractTasks[pairs[k].j]});
+        estimateTasks[k] = graph.add("homography", [&, k] {
+            MatchedPair &pair = pairs[k];
+            if (pair.j == pair.i + 1)
+            {
+                pair.homography = estimateHomography(features[pair.j].keypoints, features[pair.i].keypoints, pair.matches, options.threshold);
+                return;
+            }
+            // Images further apart may not overlap at all, the alignment then just leaves the pair out
+            try
+            {
+                pair.homography = estimateHomography(features[pair.j].keypoints, features[pair.i].keypoints, pair.matches, options.threshold);
+            }
+            catch (const std::exception &)
+            {
+                pair.homography.H.release();
+            }
+        }, {match});
+    }
+    int align = graph.add("align", [&] { result.transforms = alignGlobally(images, features, pairs, options, canvasSize, result.adjustment); }, estimateTasks);
+    for (int i = 0; i < n; ++i)
+    {
+        warpTasks[i] = graph.add("warp", [&, i] { warpIntoCanvas(images[i], result.transforms[i], canvasSize, warped[i], weights[i]); }, {align});
+    }
+    graph.add("blend", [&] { result.panorama = blendWeighted(warped, weights); }, warpTasks);
+
+    ThreadPool pool(options.numThreads);
+    graph.run(pool);
+
+    result.stages = graph.stageMetrics();
+    result.totalTimeMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    return result;
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+#include "featureDetection.h"
+#include "taskGraph.h"
+#include "bundleAdjustment.h"
+
+struct PanoramaOptions {
+    FeatureDetectorMethod method = FeatureDetectorMethod::SIFT;
+    MatchOptions matchOptions;
+    float threshold = 5.0f;
+    // 0 uses one worker per hardware thread
+    unsigned numThreads = 0;
+    // Each image is also matched with the images up to this many positions after it. Pairs beyond the
+    // neighbour give bundle adjustment the redundant constraints that remove the drift of the chain.
+    int matchSpan = 2;
+    // Refine the chained transforms jointly over the inlier correspondences of every matched pair
+    bool bundleAdjustment = true;
+    BundleAdjustmentOptions bundleAdjustmentOptions;
+};
+
+struct PanoramaResult {
+    cv::Mat panorama;
+    // Maps each input image into panorama coordinates
+    std::vector<cv::Mat> transforms;
+    std::vector<StageMetrics> stages;
+    // Per-iteration error and timing of the refinement; its transforms are relative to image 0, before the canvas shift
+    BundleAdjustmentResult adjustment;
+    double totalTimeMs;
+};
+
+// Stitch an ordered sequence of overlapping images, where image i overlaps image i + 1.
+// Load, extract, match, estimate, align, warp and blend run as a task graph on a work-stealing pool,
+// so e.g. extraction of image k + 1 overlaps matching of pair k. Alignment chains the homographies of
+// neighbouring images and then bundle-adjusts them over every matched pair.
+PanoramaResult stitchPanorama(const std::vector<std::string> &paths, const PanoramaOptions &options = PanoramaOptions());
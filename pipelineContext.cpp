@@ -0,0 +1,71 @@
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <pipelineContext.h>
+#include <profiler.h>
+
+cv::Mat acquireBuffer(cv::Mat &storage, cv::Size size, int type)
+{
+    if (size.empty())
+        return cv::Mat(size, type);
+    if (storage.type() != type || storage.empty())
+    {
+        storage.create(size, type);
+    }
+    else if (storage.cols < size.width || storage.rows < size.height)
+    {
+        storage.create(std::max(storage.rows, size.height), std::max(storage.cols, size.width), type);
+    }
+    return storage(cv::Rect(0, 0, size.width, size.height));
+}
+
+void PipelineContext::beginPair()
+{
+    const AllocationStats allocations = Profiler::instance().allocationStats();
+    pairStartAllocations = allocations.allocations;
+    pairStartBytes = allocations.allocatedBytes;
+    const HeapStats heap = Profiler::instance().heapStats();
+    pairStartHeapAllocations = heap.allocations;
+    pairStartHeapBytes = heap.allocatedBytes;
+}
+
+void PipelineContext::endPair()
+{
+    const AllocationStats allocations = Profiler::instance().allocationStats();
+    const HeapStats heap = Profiler::instance().heapStats();
+    ++stats.pairs;
+    stats.lastPairMatAllocations = allocations.allocations - pairStartAllocations;
+    stats.lastPairMatAllocatedBytes = allocations.allocatedBytes - pairStartBytes;
+    stats.matAllocations += stats.lastPairMatAllocations;
+    stats.matAllocatedBytes += stats.lastPairMatAllocatedBytes;
+    stats.lastPairHeapAllocations = heap.allocations - pairStartHeapAllocations;
+    stats.lastPairHeapAllocatedBytes = heap.allocatedBytes - pairStartHeapBytes;
+    stats.heapAllocations += stats.lastPairHeapAllocations;
+    stats.heapAllocatedBytes += stats.lastPairHeapAllocatedBytes;
+    stats.peakRssBytes = peakResidentBytes();
+
+    Profiler &profiler = Profiler::instance();
+    profiler.recordMetric("pair_mat_allocations", static_cast<double>(stats.lastPairMatAllocations));
+    profiler.recordMetric("pair_mat_bytes", static_cast<double>(stats.lastPairMatAllocatedBytes));
+    profiler.recordMetric("pair_heap_allocations", static_cast<double>(stats.lastPairHeapAllocations));
+    profiler.recordMetric("pair_heap_bytes", static_cast<double>(stats.lastPairHeapAllocatedBytes));
+}
+
+PairResult stitchPair(PipelineContext &context, const cv::Mat &image1, const cv::Mat &image2, const PairOptions &options)
+{
+    ScopedTimer timer("stitchPair");
+    context.beginPair();
+
+    const FeatureSet &features1 = extract_feature_set(image1, options.method, 0, context);
+    const FeatureSet &features2 = extract_feature_set(image2, options.method, 1, context);
+    const MatchSet &matches = match_feature_sets(features2, features1, context);
+
+    PairResult result;
+    result.homography = estimateHomography(features2, features1, matches, options.threshold, context);
+    if (!result.homography.H.empty())
+    {
+        result.panorama = stitchImages(image1, image2, result.homography.H, options.stitching, nullptr, &context);
+    }
+
+    context.endPair();
+    return result;
+}
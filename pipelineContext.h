@@ -0,0 +1,95 @@
+#pragma once
+#include <opencv2/opencv.hpp>
+#include <cstdint>
+#include <vector>
+#include "featureDetection.h"
+#include "warping.h"
+
+// Storage of one pyramid level by level, and the views of it the current image uses
+struct PyramidBuffers {
+    std::vector<cv::Mat> storage;
+    std::vector<cv::Mat> levels;
+};
+
+// Everything the FEATHERING and MULTIBAND blends allocate per call
+struct BlendScratch {
+    std::vector<int> rowMin, rowMax;
+    std::vector<float> featherWeights1, featherWeights2;
+    cv::Mat mask1, mask2, overlap, covered, result;
+    cv::Mat roi1, roi2, roiMask1, distance1, distance2, weight1, weight2;
+    PyramidBuffers laplacian1, laplacian2, weights1, weights2;
+    cv::Mat expanded1, expanded2;
+};
+
+struct PipelineMemoryStats {
+    int pairs = 0;
+    // cv::Mat buffers allocated while pairs ran, counted only while Profiler::trackMatAllocations is on.
+    // The counter is process-wide, so it is exact only when one context runs at a time.
+    std::uint64_t matAllocations = 0;
+    std::uint64_t matAllocatedBytes = 0;
+    std::uint64_t lastPairMatAllocations = 0;
+    std::uint64_t lastPairMatAllocatedBytes = 0;
+    // Global operator new calls while pairs ran, counted only while Profiler::trackHeapAllocations is on in a binary
+    // that links heapTracking.cpp. They include std::vector growth, cv::Ptr control blocks, OpenCV internals and the
+    // profiler's own spans and metrics.
+    std::uint64_t heapAllocations = 0;
+    std::uint64_t heapAllocatedBytes = 0;
+    std::uint64_t lastPairHeapAllocations = 0;
+    std::uint64_t lastPairHeapAllocatedBytes = 0;
+    // VmHWM of the process after the last pair
+    std::uint64_t peakRssBytes = 0;
+};
+
+// Scratch memory of one worker's pair pipeline, kept from pair to pair. Image-sized buffers grow to the
+// largest size seen so far and smaller pairs work in views of them, so once the largest pair has passed
+// the pipeline stops reallocating its own buffers. Not thread safe: give every worker its own context.
+struct PipelineContext {
+    // Extraction
+    FeatureDetectorMethod detectorMethod = FeatureDetectorMethod::SIFT;
+    cv::Ptr<cv::Feature2D> detector;
+    std::vector<cv::KeyPoint> keypoints;
+    cv::Mat descriptors;
+    FeatureSet features[2];
+    cv::Mat descriptorStorage[2];
+    // Matching: float copies of quantized SIFT rows, the matcher retrained on every pair, and its raw output
+    cv::Mat matchDescriptors[2];
+    FeatureMatcher matcher;
+    MatchScratch matchScratch;
+    MatchSet matches;
+    // Estimation
+    std::vector<cv::Point2f> points1, points2;
+    cv::Mat inlierMask;
+    // Stitching
+    cv::Mat canvas;
+    BlendScratch blend;
+
+    PipelineMemoryStats stats;
+
+    // Brackets one pair for the allocation counts in stats
+    void beginPair();
+    void endPair();
+
+private:
+    std::uint64_t pairStartAllocations = 0;
+    std::uint64_t pairStartBytes = 0;
+    std::uint64_t pairStartHeapAllocations = 0;
+    std::uint64_t pairStartHeapBytes = 0;
+};
+
+struct PairOptions {
+    FeatureDetectorMethod method = FeatureDetectorMethod::SIFT;
+    float threshold = 5.0f;
+    StitchingMethod stitching = StitchingMethod::FEATHERING;
+};
+
+struct PairResult {
+    // View into the context's canvas, overwritten by the next pair
+    cv::Mat panorama;
+    HomographyEstimation homography;
+};
+
+// size x type view of the front of storage, which is only reallocated when too small or of another type
+cv::Mat acquireBuffer(cv::Mat &storage, cv::Size size, int type);
+
+// extract -> match -> estimate -> stitch for one pair, every stage drawing its buffers from the context
+PairResult stitchPair(PipelineContext &context, const cv::Mat &image1, const cv::Mat &image2, const PairOptions &options = PairOptions());
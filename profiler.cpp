@@ -0,0 +1,341 @@
+#include <opencv2/core.hpp>
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <profiler.h>
+
+namespace
+{
+// Wraps the standard allocator. Buffers it hands out point back to it, so their release is counted too.
+class TrackingMatAllocator : public cv::MatAllocator
+{
+public:
+    explicit TrackingMatAllocator(cv::MatAllocator *inner) : inner(inner) {}
+
+    cv::UMatData *allocate(int dims, const int *sizes, int type, void *data, size_t *step, cv::AccessFlag flags,
+                           cv::UMatUsageFlags usageFlags) const override
+    {
+        cv::UMatData *u = inner->allocate(dims, sizes, type, data, step, flags, usageFlags);
+        if (!u)
+            return u;
+        u->currAllocator = u->prevAllocator = this;
+        if (!(u->flags & cv::UMatData::USER_ALLOCATED))
+        {
+            ++allocations;
+            allocatedBytes += u->size;
+            const std::uint64_t live = liveBytes += u->size;
+            std::uint64_t peak = peakLiveBytes.load();
+            while (live > peak && !peakLiveBytes.compare_exchange_weak(peak, live))
+            {
+            }
+        }
+        return u;
+    }
+
+    bool allocate(cv::UMatData *data, cv::AccessFlag accessFlags, cv::UMatUsageFlags usageFlags) const override
+    {
+        return inner->allocate(data, accessFlags, usageFlags);
+    }
+
+    void deallocate(cv::UMatData *data) const override
+    {
+        if (data && !(data->flags & cv::UMatData::USER_ALLOCATED))
+            liveBytes -= data->size;
+        inner->deallocate(data);
+    }
+
+    cv::MatAllocator *inner;
+    mutable std::atomic<std::uint64_t> allocations{0}, allocatedBytes{0}, liveBytes{0}, peakLiveBytes{0};
+};
+
+// Never destroyed: cv::Mat buffers allocated through it may outlive main
+TrackingMatAllocator &trackingAllocator()
+{
+    static TrackingMatAllocator *allocator = new TrackingMatAllocator(cv::Mat::getStdAllocator());
+    return *allocator;
+}
+
+std::string escapeJson(const std::string &text)
+{
+    std::string escaped;
+    for (char c : text)
+    {
+        if (c == '"' || c == '\\')
+            escaped += '\\';
+        escaped += c;
+    }
+    return escaped;
+}
+
+std::ofstream openOutput(const std::string &path)
+{
+    std::ofstream out(path);
+    if (!out)
+    {
+        throw std::runtime_error("Could not write profile " + path);
+    }
+    return out;
+}
+}
+
+HeapCounters &heapCounters()
+{
+    // Constant-initialized, so it is usable from an operator new that runs before main
+    static HeapCounters counters;
+    return counters;
+}
+
+Profiler &Profiler::instance()
+{
+    static Profiler profiler;
+    return profiler;
+}
+
+Profiler::Profiler() : active(true), epoch(std::chrono::high_resolution_clock::now())
+{
+}
+
+Profiler::ThreadBuffer &Profiler::threadBuffer()
+{
+    thread_local std::shared_ptr<ThreadBuffer> buffer;
+    if (!buffer)
+    {
+        buffer = std::make_shared<ThreadBuffer>();
+        std::lock_guard<std::mutex> lock(buffersMutex);
+        buffer->threadId = static_cast<int>(buffers.size());
+        buffers.push_back(buffer);
+    }
+    return *buffer;
+}
+
+void Profiler::setLabel(const std::string &label)
+{
+    ThreadBuffer &buffer = threadBuffer();
+    std::lock_guard<std::mutex> lock(buffer.mutex);
+    buffer.label = label;
+}
+
+void Profiler::trackMatAllocations(bool enabled)
+{
+    cv::Mat::setDefaultAllocator(enabled ? &trackingAllocator() : cv::Mat::getStdAllocator());
+}
+
+void Profiler::trackHeapAllocations(bool enabled)
+{
+    heapCounters().tracking.store(enabled);
+}
+
+void Profiler::recordSpan(const char *name, const char *category, std::chrono::high_resolution_clock::time_point start,
+                          std::chrono::high_resolution_clock::time_point end)
+{
+    if (!enabled())
+        return;
+    ThreadBuffer &buffer = threadBuffer();
+    std::lock_guard<std::mutex> lock(buffer.mutex);
+    buffer.events.push_back({name, category, buffer.label, std::chrono::duration<double, std::micro>(start - epoch).count(),
+                             std::chrono::duration<double, std::micro>(end - start).count(), buffer.threadId});
+}
+
+void Profiler::addCounter(const char *name, double delta)
+{
+    if (!enabled())
+        return;
+    ThreadBuffer &buffer = threadBuffer();
+    std::lock_guard<std::mutex> lock(buffer.mutex);
+    buffer.counters[name] += delta;
+}
+
+void Profiler::recordMetric(const char *name, double value)
+{
+    if (!enabled())
+        return;
+    ThreadBuffer &buffer = threadBuffer();
+    std::lock_guard<std::mutex> lock(buffer.mutex);
+    buffer.metrics.push_back({name, buffer.label, value});
+}
+
+std::vector<TraceEvent> Profiler::events() const
+{
+    std::vector<TraceEvent> merged;
+    std::lock_guard<std::mutex> lock(buffersMutex);
+    for (const auto &buffer : buffers)
+    {
+        std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+        merged.insert(merged.end(), buffer->events.begin(), buffer->events.end());
+    }
+    std::sort(merged.begin(), merged.end(), [](const TraceEvent &a, const TraceEvent &b) { return a.startUs < b.startUs; });
+    return merged;
+}
+
+std::vector<MetricSample> Profiler::metrics() const
+{
+    // Metrics are read back per label in recording order, which only holds within one thread,
+    // so the buffers are concatenated rather than interleaved
+    std::vector<MetricSample> merged;
+    std::lock_guard<std::mutex> lock(buffersMutex);
+    for (const auto &buffer : buffers)
+    {
+        std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+        merged.insert(merged.end(), buffer->metrics.begin(), buffer->metrics.end());
+    }
+    return merged;
+}
+
+std::map<std::string, double> Profiler::counters() const
+{
+    std::map<std::string, double> merged;
+    std::lock_guard<std::mutex> lock(buffersMutex);
+    for (const auto &buffer : buffers)
+    {
+        std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+        for (const auto &counter : buffer->counters)
+        {
+            merged[counter.first] += counter.second;
+        }
+    }
+    return merged;
+}
+
+std::vector<SpanSummary> Profiler::summary() const
+{
+    std::map<std::string, SpanSummary> byName;
+    for (const auto &event : events())
+    {
+        auto inserted = byName.emplace(event.name, SpanSummary{event.name, event.category, 0, 0.0, 0.0, std::numeric_limits<double>::max(), 0.0});
+        SpanSummary &span = inserted.first->second;
+        const double ms = event.durationUs / 1000.0;
+        ++span.count;
+        span.totalMs += ms;
+        span.minMs = std::min(span.minMs, ms);
+        span.maxMs = std::max(span.maxMs, ms);
+    }
+
+    std::vector<SpanSummary> spans;
+    for (auto &entry : byName)
+    {
+        entry.second.meanMs = entry.second.totalMs / entry.second.count;
+        spans.push_back(entry.second);
+    }
+    return spans;
+}
+
+AllocationStats Profiler::allocationStats() const
+{
+    const TrackingMatAllocator &allocator = trackingAllocator();
+    return {allocator.allocations.load(), allocator.allocatedBytes.load(), allocator.liveBytes.load(), allocator.peakLiveBytes.load()};
+}
+
+HeapStats Profiler::heapStats() const
+{
+    const HeapCounters &counters = heapCounters();
+    return {counters.allocations.load(), counters.allocatedBytes.load()};
+}
+
+bool Profiler::heapTrackingAvailable() const
+{
+    return heapCounters().installed.load();
+}
+
+std::vector<double> Profiler::metricValues(const std::string &name, const std::string &label) const
+{
+    std::vector<double> values;
+    for (const auto &sample : metrics())
+    {
+        if (sample.name == name && sample.label == label)
+            values.push_back(sample.value);
+    }
+    return values;
+}
+
+void Profiler::writeJson(const std::string &path) const
+{
+    std::ofstream out = openOutput(path);
+    out << "{\n  \"spans\": [";
+    const std::vector<SpanSummary> spans = summary();
+    for (size_t i = 0; i < spans.size(); ++i)
+    {
+        const SpanSummary &span = spans[i];
+        out << (i ? ",\n    " : "\n    ") << "{\"name\": \"" << escapeJson(span.name) << "\", \"category\": \"" << escapeJson(span.category)
+            << "\", \"count\": " << span.count << ", \"total_ms\": " << span.totalMs << ", \"mean_ms\": " << span.meanMs
+            << ", \"min_ms\": " << span.minMs << ", \"max_ms\": " << span.maxMs << "}";
+    }
+    out << "\n  ],\n  \"counters\": {";
+    bool first = true;
+    for (const auto &counter : counters())
+    {
+        out << (first ? "\n    " : ",\n    ") << "\"" << escapeJson(counter.first) << "\": " << counter.second;
+        first = false;
+    }
+    out << "\n  },\n  \"metrics\": [";
+    const std::vector<MetricSample> samples = metrics();
+    for (size_t i = 0; i < samples.size(); ++i)
+    {
+        out << (i ? ",\n    " : "\n    ") << "{\"name\": \"" << escapeJson(samples[i].name) << "\", \"label\": \"" << escapeJson(samples[i].label)
+            << "\", \"value\": " << samples[i].value << "}";
+    }
+    const AllocationStats allocations = allocationStats();
+    out << "\n  ],\n  \"allocations\": {\"count\": " << allocations.allocations << ", \"bytes\": " << allocations.allocatedBytes
+        << ", \"live_bytes\": " << allocations.liveBytes << ", \"peak_live_bytes\": " << allocations.peakLiveBytes << "}\n}\n";
+}
+
+void Profiler::writeCsv(const std::string &path) const
+{
+    std::ofstream out = openOutput(path);
+    out << "kind,name,label,count,total_ms,mean_ms,min_ms,max_ms,value\n";
+    for (const auto &span : summary())
+    {
+        out << "span," << span.name << ",," << span.count << "," << span.totalMs << "," << span.meanMs << "," << span.minMs << "," << span.maxMs << ",\n";
+    }
+    for (const auto &counter : counters())
+    {
+        out << "counter," << counter.first << ",,,,,,," << counter.second << "\n";
+    }
+    for (const auto &sample : metrics())
+    {
+        out << "metric," << sample.name << "," << sample.label << ",,,,,," << sample.value << "\n";
+    }
+    const AllocationStats allocations = allocationStats();
+    out << "allocation,count,,,,,,," << allocations.allocations << "\n"
+        << "allocation,bytes,,,,,,," << allocations.allocatedBytes << "\n"
+        << "allocation,peak_live_bytes,,,,,,," << allocations.peakLiveBytes << "\n";
+}
+
+void Profiler::writeChromeTrace(const std::string &path) const
+{
+    std::ofstream out = openOutput(path);
+    out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+    const std::vector<TraceEvent> trace = events();
+    for (size_t i = 0; i < trace.size(); ++i)
+    {
+        const TraceEvent &event = trace[i];
+        out << (i ? ",\n" : "\n") << "{\"name\": \"" << escapeJson(event.name) << "\", \"cat\": \"" << escapeJson(event.category)
+            << "\", \"ph\": \"X\", \"ts\": " << event.startUs << ", \"dur\": " << event.durationUs << ", \"pid\": 0, \"tid\": " << event.threadId
+            << ", \"args\": {\"label\": \"" << escapeJson(event.label) << "\"}}";
+    }
+    out << "\n]}\n";
+}
+
+std::uint64_t peakResidentBytes()
+{
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line))
+    {
+        if (line.rfind("VmHWM:", 0) == 0)
+            return std::stoull(line.substr(6)) * 1024;
+    }
+    return 0;
+}
+
+void Profiler::reset()
+{
+    std::lock_guard<std::mutex> lock(buffersMutex);
+    for (const auto &buffer : buffers)
+    {
+        std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+        buffer->events.clear();
+        buffer->metrics.clear();
+        buffer->counters.clear();
+    }
+}
@@ -0,0 +1,136 @@
+#pragma once
+#include <opencv2/core.hpp>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// One timed region, relative to the profiler's start
+struct TraceEvent {
+    std::string name;
+    std::string category;
+    std::string label;
+    double startUs;
+    double durationUs;
+    int threadId;
+};
+
+// A named value (keypoints, inliers, ...) recorded under the label active on the recording thread
+struct MetricSample {
+    std::string name;
+    std::string label;
+    double value;
+};
+
+struct SpanSummary {
+    std::string name;
+    std::string category;
+    int count;
+    double totalMs;
+    double meanMs;
+    double minMs;
+    double maxMs;
+};
+
+// Every global operator new, see Profiler::trackHeapAllocations
+struct HeapStats {
+    std::uint64_t allocations;
+    std::uint64_t allocatedBytes;
+};
+
+// cv::Mat buffers only, see Profiler::trackMatAllocations
+struct AllocationStats {
+    std::uint64_t allocations;
+    std::uint64_t allocatedBytes;
+    std::uint64_t liveBytes;
+    std::uint64_t peakLiveBytes;
+};
+
+// Process-wide collector of timed spans, counters and labelled metrics. Every thread records into its own
+// buffer, so recording only takes an uncontended lock; the buffers are merged when results are read.
+class Profiler {
+public:
+    static Profiler &instance();
+
+    void setEnabled(bool enabled) { active.store(enabled); }
+    bool enabled() const { return active.load(std::memory_order_relaxed); }
+    // Attached to everything the calling thread records from now on, e.g. "pair1/sift".
+    // Worker threads of cv::parallel_for_ keep their own (empty) label.
+    void setLabel(const std::string &label);
+    // Installs a cv::MatAllocator that counts every cv::Mat buffer allocated afterwards
+    void trackMatAllocations(bool enabled);
+    // Counts every global operator new from now on: containers, cv::Ptr, OpenCV internals and the profiler's own
+    // records, but not the cv::Mat buffers, which go through malloc. Only binaries that link heapTracking.cpp
+    // count anything; the others keep the standard operator new and report zeros.
+    void trackHeapAllocations(bool enabled);
+    bool heapTrackingAvailable() const;
+
+    void recordSpan(const char *name, const char *category, std::chrono::high_resolution_clock::time_point start,
+                    std::chrono::high_resolution_clock::time_point end);
+    void addCounter(const char *name, double delta);
+    void recordMetric(const char *name, double value);
+
+    std::vector<TraceEvent> events() const;
+    std::vector<MetricSample> metrics() const;
+    std::map<std::string, double> counters() const;
+    std::vector<SpanSummary> summary() const;
+    AllocationStats allocationStats() const;
+    HeapStats heapStats() const;
+    // Values of one metric recorded under exactly this label, in recording order
+    std::vector<double> metricValues(const std::string &name, const std::string &label) const;
+
+    void writeJson(const std::string &path) const;
+    void writeCsv(const std::string &path) const;
+    // Chrome trace-event format, for chrome://tracing or Perfetto
+    void writeChromeTrace(const std::string &path) const;
+    void reset();
+
+private:
+    struct ThreadBuffer {
+        std::mutex mutex;
+        int threadId;
+        std::string label;
+        std::vector<TraceEvent> events;
+        std::vector<MetricSample> metrics;
+        std::map<std::string, double> counters;
+    };
+
+    Profiler();
+    ThreadBuffer &threadBuffer();
+
+    std::atomic<bool> active;
+    std::chrono::high_resolution_clock::time_point epoch;
+    mutable std::mutex buffersMutex;
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+};
+
+// Shared with the operator new replacement in heapTracking.cpp, which sets installed when it is linked
+struct HeapCounters {
+    std::atomic<bool> installed{false};
+    std::atomic<bool> tracking{false};
+    std::atomic<std::uint64_t> allocations{0};
+    std::atomic<std::uint64_t> allocatedBytes{0};
+};
+HeapCounters &heapCounters();
+
+// Peak resident set size of the process (VmHWM), 0 where /proc is not available
+std::uint64_t peakResidentBytes();
+
+// Records the enclosing scope as a span when it ends
+class ScopedTimer {
+public:
+    explicit ScopedTimer(const char *name, const char *category = "pipeline")
+        : name(name), category(category), start(std::chrono::high_resolution_clock::now()) {}
+    ~ScopedTimer() { Profiler::instance().recordSpan(name, category, start, std::chrono::high_resolution_clock::now()); }
+    ScopedTimer(const ScopedTimer &) = delete;
+    ScopedTimer &operator=(const ScopedTimer &) = delete;
+
+private:
+    const char *name;
+    const char *category;
+    std::chrono::high_resolution_clock::time_point start;
+};
@@ -0,0 +1,605 @@
+#include <opencv2/opencv.hpp>
+#include <opencv2/core/hal/intrin.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <ransac.h>
+#include <profiler.h>
+
+double InlierCountScorer::cost(const float *squaredResiduals, int count, float squaredThreshold) const
+{
+    int outliers = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        outliers += squaredResiduals[i] < squaredThreshold ? 0 : 1;
+    }
+    return outliers;
+}
+
+double MsacScorer::cost(const float *squaredResiduals, int count, float squaredThreshold) const
+{
+    double sum = 0.0;
+    for (int i = 0; i < count; ++i)
+    {
+        // written so that NaN residuals count as outliers
+        sum += squaredResiduals[i] < squaredThreshold ? squaredResiduals[i] : squaredThreshold;
+    }
+    return sum;
+}
+
+namespace
+{
+// Structure-of-arrays copy of the matched points, so residuals can be computed several lanes at a time
+struct Correspondences
+{
+    std::vector<float> x1, y1, x2, y2;
+    int size() const { return static_cast<int>(x1.size()); }
+};
+
+struct Hypothesis
+{
+    cv::Matx33d H;
+    double cost = std::numeric_limits<double>::infinity();
+    int numInliers = 0;
+    bool valid = false;
+};
+
+// Points verified between two SPRT decisions
+const int SPRT_CHUNK = 64;
+// Probability that a correspondence is consistent with a bad model
+const double SPRT_DELTA = 0.05;
+
+void squaredResiduals(const cv::Matx33d &H, const Correspondences &c, int begin, int end, float *out)
+{
+    const float h[9] = {static_cast<float>(H(0, 0)), static_cast<float>(H(0, 1)), static_cast<float>(H(0, 2)),
+                        static_cast<float>(H(1, 0)), static_cast<float>(H(1, 1)), static_cast<float>(H(1, 2)),
+                        static_cast<float>(H(2, 0)), static_cast<float>(H(2, 1)), static_cast<float>(H(2, 2))};
+    int i = begin;
+#if CV_SIMD
+    const int lanes = cv::v_float32::nlanes;
+    const cv::v_float32 h0 = cv::vx_setall_f32(h[0]), h1 = cv::vx_setall_f32(h[1]), h2 = cv::vx_setall_f32(h[2]);
+    const cv::v_float32 h3 = cv::vx_setall_f32(h[3]), h4 = cv::vx_setall_f32(h[4]), h5 = cv::vx_setall_f32(h[5]);
+    const cv::v_float32 h6 = cv::vx_setall_f32(h[6]), h7 = cv::vx_setall_f32(h[7]), h8 = cv::vx_setall_f32(h[8]);
+    const cv::v_float32 one = cv::vx_setall_f32(1.0f);
+    for (; i <= end - lanes; i += lanes)
+    {
+        cv::v_float32 x = cv::vx_load(c.x1.data() + i), y = cv::vx_load(c.y1.data() + i);
+        cv::v_float32 invW = one / cv::v_fma(h6, x, cv::v_fma(h7, y, h8));
+        cv::v_float32 dx = cv::v_fma(h0, x, cv::v_fma(h1, y, h2)) * invW - cv::vx_load(c.x2.data() + i);
+        cv::v_float32 dy = cv::v_fma(h3, x, cv::v_fma(h4, y, h5)) * invW - cv::vx_load(c.y2.data() + i);
+        cv::v_store(out + i, cv::v_fma(dx, dx, dy * dy));
+    }
+#endif
+    for (; i < end; ++i)
+    {
+        const float x = c.x1[i], y = c.y1[i];
+        const float invW = 1.0f / (h[6] * x + h[7] * y + h[8]);
+        const float dx = (h[0] * x + h[1] * y + h[2]) * invW - c.x2[i];
+        const float dy = (h[3] * x + h[4] * y + h[5]) * invW - c.y2[i];
+        out[i] = dx * dx + dy * dy;
+    }
+}
+
+int countInliers(const float *squared, int count, float squaredThreshold)
+{
+    int inliers = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        inliers += squared[i] < squaredThreshold ? 1 : 0;
+    }
+    return inliers;
+}
+
+// Verify H against all correspondences and score it at every threshold. With SPRT enabled verification stops,
+// and false is returned, as soon as the likelihood ratio at squaredThresholds[sprtIndex] says the model is bad.
+bool evaluate(const cv::Matx33d &H, const Correspondences &c, const RansacScorer &scorer, const float *squaredThresholds, int numThresholds,
+              int sprtIndex, bool sprt, double epsilon, double logThreshold, float *residuals, Hypothesis *hypotheses)
+{
+    const int n = c.size();
+    const double logInlierStep = std::log(SPRT_DELTA / epsilon);
+    const double logOutlierStep = std::log((1.0 - SPRT_DELTA) / (1.0 - epsilon));
+    double logLikelihoodRatio = 0.0;
+
+    for (int begin = 0; begin < n; begin += SPRT_CHUNK)
+    {
+        const int end = std::min(begin + SPRT_CHUNK, n);
+        squaredResiduals(H, c, begin, end, residuals);
+        if (sprt)
+        {
+            const int chunkInliers = countInliers(residuals + begin, end - begin, squaredThresholds[sprtIndex]);
+            logLikelihoodRatio += chunkInliers * logInlierStep + (end - begin - chunkInliers) * logOutlierStep;
+            if (logLikelihoodRatio > logThreshold)
+                return false;
+        }
+    }
+
+    // The residuals are shared, only the scoring is repeated per threshold
+    for (int t = 0; t < numThresholds; ++t)
+    {
+        hypotheses[t].H = H;
+        hypotheses[t].cost = scorer.cost(residuals, n, squaredThresholds[t]);
+        hypotheses[t].numInliers = countInliers(residuals, n, squaredThresholds[t]);
+        hypotheses[t].valid = true;
+    }
+    return true;
+}
+
+bool evaluate(const cv::Matx33d &H, const Correspondences &c, const RansacScorer &scorer, float squaredThreshold, float *residuals, Hypothesis &hypothesis)
+{
+    return evaluate(H, c, scorer, &squaredThreshold, 1, 0, false, 0.5, 0.0, residuals, &hypothesis);
+}
+
+// SPRT decision threshold A (as log A) for the current inlier ratio estimate, following Chum & Matas
+double sprtLogThreshold(double epsilon)
+{
+    const double delta = SPRT_DELTA;
+    const double C = (1.0 - delta) * std::log((1.0 - delta) / (1.0 - epsilon)) + delta * std::log(delta / epsilon);
+    // time to generate a hypothesis in units of verifying one correspondence
+    const double modelCost = 200.0;
+    const double K = modelCost * C + 1.0;
+    double A = K;
+    for (int i = 0; i < 10; ++i)
+    {
+        A = K + std::log(A);
+    }
+    return std::log(A);
+}
+
+// Subset size PROSAC samples from at every iteration: grows from the 4 best matches to all of them
+std::vector<int> prosacSchedule(int n, int maxIterations)
+{
+    const int m = 4;
+    std::vector<int> sizes(maxIterations);
+    double Tn = maxIterations;
+    for (int i = 0; i < m; ++i)
+    {
+        Tn *= static_cast<double>(m - i) / (n - i);
+    }
+    double TnPrime = 1.0;
+    int subset = m;
+    for (int t = 1; t <= maxIterations; ++t)
+    {
+        if (t > TnPrime && subset < n)
+        {
+            const double nextTn = Tn * (subset + 1) / (subset + 1 - m);
+            TnPrime += std::ceil(nextTn - Tn);
+            Tn = nextTn;
+            ++subset;
+        }
+        sizes[t - 1] = subset;
+    }
+    return sizes;
+}
+
+bool collinear(const cv::Point2f &a, const cv::Point2f &b, const cv::Point2f &c)
+{
+    return std::abs((b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x)) < 1.0f;
+}
+
+bool degenerate(const cv::Point2f p[4])
+{
+    return collinear(p[0], p[1], p[2]) || collinear(p[0], p[1], p[3]) || collinear(p[0], p[2], p[3]) || collinear(p[1], p[2], p[3]);
+}
+
+bool isFinite(const cv::Matx33d &H)
+{
+    for (int i = 0; i < 9; ++i)
+    {
+        if (!std::isfinite(H.val[i]))
+            return false;
+    }
+    return true;
+}
+
+bool sampleHypothesis(const Correspondences &c, int subsetSize, bool prosac, cv::RNG &rng, cv::Matx33d &H)
+{
+    int indices[4];
+    int drawn = 0;
+    if (prosac)
+    {
+        // The newest member of the subset is always part of the sample
+        indices[drawn++] = subsetSize - 1;
+    }
+    const int range = prosac ? subsetSize - 1 : c.size();
+    while (drawn < 4)
+    {
+        int index = rng.uniform(0, range);
+        if (std::find(indices, indices + drawn, index) == indices + drawn)
+            indices[drawn++] = index;
+    }
+
+    cv::Point2f src[4], dst[4];
+    for (int i = 0; i < 4; ++i)
+    {
+        src[i] = cv::Point2f(c.x1[indices[i]], c.y1[indices[i]]);
+        dst[i] = cv::Point2f(c.x2[indices[i]], c.y2[indices[i]]);
+    }
+    if (degenerate(src) || degenerate(dst))
+        return false;
+
+    cv::Mat minimal = cv::getPerspectiveTransform(src, dst);
+    H = cv::Matx33d(minimal.ptr<double>());
+    return isFinite(H) && std::abs(cv::determinant(H)) > 1e-12;
+}
+
+// Weighted normalized DLT; correspondences with zero weight are ignored
+bool fitHomography(const Correspondences &c, const std::vector<float> &weights, cv::Matx33d &H)
+{
+    const int n = c.size();
+    double weightSum = 0.0, m1x = 0.0, m1y = 0.0, m2x = 0.0, m2y = 0.0;
+    int used = 0;
+    for (int i = 0; i < n; ++i)
+    {
+        const double w = weights[i];
+        if (w <= 0.0)
+            continue;
+        weightSum += w;
+        m1x += w * c.x1[i];
+        m1y += w * c.y1[i];
+        m2x += w * c.x2[i];
+        m2y += w * c.y2[i];
+        ++used;
+    }
+    if (used < 4)
+        return false;
+    m1x /= weightSum;
+    m1y /= weightSum;
+    m2x /= weightSum;
+    m2y /= weightSum;
+
+    double spread1 = 0.0, spread2 = 0.0;
+    for (int i = 0; i < n; ++i)
+    {
+        const double w = weights[i];
+        if (w <= 0.0)
+            continue;
+        spread1 += w * std::hypot(c.x1[i] - m1x, c.y1[i] - m1y);
+        spread2 += w * std::hypot(c.x2[i] - m2x, c.y2[i] - m2y);
+    }
+    spread1 /= weightSum;
+    spread2 /= weightSum;
+    if (spread1 < 1e-9 || spread2 < 1e-9)
+        return false;
+    const double s1 = std::sqrt(2.0) / spread1, s2 = std::sqrt(2.0) / spread2;
+
+    cv::Matx<double, 9, 9> M = cv::Matx<double, 9, 9>::zeros();
+    for (int i = 0; i < n; ++i)
+    {
+        const double w = weights[i];
+        if (w <= 0.0)
+            continue;
+        const double x = (c.x1[i] - m1x) * s1, y = (c.y1[i] - m1y) * s1;
+        const double u = (c.x2[i] - m2x) * s2, v = (c.y2[i] - m2y) * s2;
+        const double a[9] = {x, y, 1.0, 0.0, 0.0, 0.0, -u * x, -u * y, -u};
+        const double b[9] = {0.0, 0.0, 0.0, x, y, 1.0, -v * x, -v * y, -v};
+        for (int r = 0; r < 9; ++r)
+        {
+            for (int col = r; col < 9; ++col)
+            {
+                M(r, col) += w * (a[r] * a[col] + b[r] * b[col]);
+            }
+        }
+    }
+    for (int r = 0; r < 9; ++r)
+    {
+        for (int col = 0; col < r; ++col)
+        {
+            M(r, col) = M(col, r);
+        }
+    }
+
+    cv::Mat eigenvalues, eigenvectors;
+    cv::eigen(cv::Mat(M), eigenvalues, eigenvectors);
+    cv::Matx33d normalized(eigenvectors.ptr<double>(8));
+
+    const cv::Matx33d T1(s1, 0.0, -s1 * m1x, 0.0, s1, -s1 * m1y, 0.0, 0.0, 1.0);
+    const cv::Matx33d T2inv(1.0 / s2, 0.0, m2x, 0.0, 1.0 / s2, m2y, 0.0, 0.0, 1.0);
+    H = T2inv * normalized * T1;
+    if (std::abs(H(2, 2)) > 1e-12)
+        H *= 1.0 / H(2, 2);
+    return isFinite(H);
+}
+
+// LO-RANSAC inner loop: refit on the inliers of the current model while the cost keeps dropping
+Hypothesis localOptimize(Hypothesis best, const Correspondences &c, const RansacScorer &scorer, float squaredThreshold, int iterations)
+{
+    const int n = c.size();
+    std::vector<float> residuals(n), weights(n);
+    for (int iteration = 0; iteration < iterations; ++iteration)
+    {
+        squaredResiduals(best.H, c, 0, n, residuals.data());
+        for (int i = 0; i < n; ++i)
+        {
+            weights[i] = residuals[i] < squaredThreshold ? 1.0f : 0.0f;
+        }
+
+        cv::Matx33d H;
+        Hypothesis refined;
+        if (!fitHomography(c, weights, H) || !evaluate(H, c, scorer, squaredThreshold, residuals.data(), refined) || refined.cost >= best.cost)
+            break;
+        best = refined;
+    }
+    return best;
+}
+
+// Sigma-consensus in the spirit of MAGSAC++: instead of a hard threshold, every correspondence is
+// weighted by how plausible it is as an inlier up to a maximum noise level of three thresholds
+Hypothesis magsacRefine(Hypothesis best, const Correspondences &c, const RansacScorer &scorer, float threshold, int iterations)
+{
+    const int n = c.size();
+    const float squaredThreshold = threshold * threshold;
+    const float maxSquaredResidual = 9.0f * squaredThreshold;
+    std::vector<float> residuals(n), weights(n);
+    Hypothesis current = best;
+    for (int iteration = 0; iteration < iterations; ++iteration)
+    {
+        squaredResiduals(current.H, c, 0, n, residuals.data());
+        for (int i = 0; i < n; ++i)
+        {
+            const float r = residuals[i] / maxSquaredResidual;
+            weights[i] = r < 1.0f ? (1.0f - r) * (1.0f - r) : 0.0f;
+        }
+
+        cv::Matx33d H;
+        Hypothesis refined;
+        if (!fitHomography(c, weights, H) || !evaluate(H, c, scorer, squaredThreshold, residuals.data(), refined))
+            break;
+        current = refined;
+        if (current.cost <= best.cost)
+            best = current;
+    }
+    return best;
+}
+
+void checkSweepInput(const std::vector<float> &thresholds)
+{
+    if (thresholds.empty())
+    {
+        throw std::invalid_argument("No reprojection thresholds given");
+    }
+}
+
+// Fewer than four matches determine no homography: one empty estimation per threshold, with no inliers and an
+// infinite alignment error, as estimateHomography reports it
+std::vector<HomographyEstimation> emptySweep(size_t numThresholds)
+{
+    HomographyEstimation empty;
+    empty.numInliers = 0;
+    empty.estimationTimeMs = 0.0f;
+    empty.alignmentError = std::numeric_limits<float>::infinity();
+    empty.iterations = 0;
+    empty.timePerIterationUs = 0.0f;
+    std::vector<HomographyEstimation> results(numThresholds, empty);
+    for (const auto &result : results)
+    {
+        recordEstimationMetrics(result);
+    }
+    return results;
+}
+
+// PROSAC needs the correspondences ordered from most to least distinctive. distance(i) is the descriptor
+// distance of match i, gather(i, x1, y1, x2, y2) reads its two positions.
+template <typename Distance, typename Gather>
+Correspondences gatherCorrespondences(int n, bool prosac, Distance distance, Gather gather)
+{
+    std::vector<int> order(n);
+    std::iota(order.begin(), order.end(), 0);
+    if (prosac)
+    {
+        std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return distance(a) < distance(b); });
+    }
+    Correspondences c;
+    c.x1.resize(n);
+    c.y1.resize(n);
+    c.x2.resize(n);
+    c.y2.resize(n);
+    for (int i = 0; i < n; ++i)
+    {
+        gather(order[i], c.x1[i], c.y1[i], c.x2[i], c.y2[i]);
+    }
+    return c;
+}
+
+std::vector<HomographyEstimation> runSweep(const Correspondences &c, const std::vector<float> &thresholds, const RansacOptions &options,
+                                           std::chrono::high_resolution_clock::time_point estimationStart)
+{
+    const int n = c.size();
+    const int numThresholds = static_cast<int>(thresholds.size());
+
+    const MsacScorer defaultScorer;
+    const RansacScorer &scorer = options.scorer ? *options.scorer : defaultScorer;
+    std::vector<float> squaredThresholds(numThresholds);
+    for (int t = 0; t < numThresholds; ++t)
+    {
+        squaredThresholds[t] = thresholds[t] * thresholds[t];
+    }
+    // SPRT runs against the loosest threshold, a model rejected there has even fewer inliers at the others
+    const int loosest = static_cast<int>(std::max_element(thresholds.begin(), thresholds.end()) - thresholds.begin());
+    const int maxIterations = std::max(1, options.maxIterations);
+    const int batchSize = std::max(1, options.batchSize);
+    const std::vector<int> subsetSizes = options.prosac ? prosacSchedule(n, maxIterations) : std::vector<int>();
+
+    std::vector<Hypothesis> best(numThresholds);
+    int iterations = 0;
+    int requiredIterations = maxIterations;
+    while (iterations < requiredIterations)
+    {
+        const int batch = std::min(batchSize, requiredIterations - iterations);
+        const double epsilon = best[loosest].valid ? static_cast<double>(best[loosest].numInliers) / n : 0.0;
+        // SPRT needs an inlier ratio estimate, so the first batch is always verified fully
+        const bool sprt = options.sprt && epsilon > SPRT_DELTA + 0.01 && epsilon < 1.0;
+        const double logThreshold = sprt ? sprtLogThreshold(epsilon) : 0.0;
+
+        // candidates[b * numThresholds + t] is hypothesis b scored at threshold t
+        std::vector<Hypothesis> candidates(static_cast<size_t>(batch) * numThresholds);
+        cv::parallel_for_(cv::Range(0, batch), [&](const cv::Range &range)
+        {
+            std::vector<float> residuals(n);
+            for (int b = range.start; b < range.end; ++b)
+            {
+                const int iteration = iterations + b;
+                // Seeded per iteration, so results do not depend on how batches are split across threads
+                cv::RNG rng(options.seed + 0x9E3779B97F4A7C15ULL * (iteration + 1));
+                cv::Matx33d H;
+                if (!sampleHypothesis(c, options.prosac ? subsetSizes[iteration] : n, options.prosac, rng, H))
+                    continue;
+                evaluate(H, c, scorer, squaredThresholds.data(), numThresholds, loosest, sprt, sprt ? epsilon : 0.5, logThreshold,
+                         residuals.data(), &candidates[static_cast<size_t>(b) * numThresholds]);
+            }
+        });
+        iterations += batch;
+
+        requiredIterations = 0;
+        for (int t = 0; t < numThresholds; ++t)
+        {
+            const Hypothesis *batchBest = nullptr;
+            for (int b = 0; b < batch; ++b)
+            {
+                const Hypothesis &candidate = candidates[static_cast<size_t>(b) * numThresholds + t];
+                if (candidate.valid && (!batchBest || candidate.cost < batchBest->cost))
+                    batchBest = &candidate;
+            }
+            if (batchBest && batchBest->cost < best[t].cost)
+            {
+                best[t] = *batchBest;
+                if (options.refinement == RansacRefinement::LOCAL_OPTIMIZATION)
+                    best[t] = localOptimize(best[t], c, scorer, squaredThresholds[t], 4);
+            }
+
+            // Adaptive stop: iterations needed to draw one all-inlier sample with the requested confidence.
+            // The tightest threshold usually needs the most, the sweep runs until every threshold is satisfied.
+            int required = maxIterations;
+            if (best[t].valid && best[t].numInliers > 0)
+            {
+                const double inlierRatio = static_cast<double>(best[t].numInliers) / n;
+                const double allInliers = std::pow(inlierRatio, 4);
+                if (allInliers >= 1.0)
+                {
+                    required = iterations;
+                }
+                else if (allInliers > 0.0)
+                {
+                    const double needed = std::log(1.0 - options.confidence) / std::log(1.0 - allInliers);
+                    required = static_cast<int>(std::min<double>(maxIterations, std::ceil(needed)));
+                }
+            }
+            requiredIterations = std::max(requiredIterations, required);
+        }
+    }
+
+    auto samplingEnd = std::chrono::high_resolution_clock::now();
+    // Sampling and scoring are shared, so every threshold is charged an equal part of them in estimationTimeMs;
+    // an iteration scores all thresholds at once, so timePerIterationUs uses the whole sampling time
+    const float samplingTimeMs = std::chrono::duration<float, std::milli>(samplingEnd - estimationStart).count();
+    const float sharedTimeMs = samplingTimeMs / numThresholds;
+
+    std::vector<cv::Point2f> points1(n), points2(n);
+    for (int i = 0; i < n; ++i)
+    {
+        points1[i] = cv::Point2f(c.x1[i], c.y1[i]);
+        points2[i] = cv::Point2f(c.x2[i], c.y2[i]);
+    }
+
+    std::vector<HomographyEstimation> results(numThresholds);
+    for (int t = 0; t < numThresholds; ++t)
+    {
+        auto refinementStart = std::chrono::high_resolution_clock::now();
+        Hypothesis &model = best[t];
+        if (model.valid)
+        {
+            switch (options.refinement)
+            {
+            case RansacRefinement::NONE:
+                model = localOptimize(model, c, scorer, squaredThresholds[t], 1);
+                break;
+            case RansacRefinement::LOCAL_OPTIMIZATION:
+                model = localOptimize(model, c, scorer, squaredThresholds[t], 4);
+                break;
+            case RansacRefinement::MAGSAC:
+                model = magsacRefine(model, c, scorer, thresholds[t], 5);
+                break;
+            }
+        }
+        auto refinementEnd = std::chrono::high_resolution_clock::now();
+
+        HomographyEstimation &result = results[t];
+        result.estimationTimeMs = sharedTimeMs + std::chrono::duration<float, std::milli>(refinementEnd - refinementStart).count();
+        result.iterations = iterations;
+        result.timePerIterationUs = samplingTimeMs * 1000.0f / iterations;
+        result.numInliers = model.valid ? model.numInliers : 0;
+        if (!model.valid)
+        {
+            result.alignmentError = std::numeric_limits<float>::infinity();
+            continue;
+        }
+        result.H = cv::Mat(model.H, true);
+        result.alignmentError = computeAlignmentError(points1, points2, result.H);
+    }
+    for (const auto &result : results)
+    {
+        recordEstimationMetrics(result);
+    }
+    return results;
+}
+}
+
+HomographyEstimation estimateHomographyRansac(const std::vector<cv::KeyPoint> &keypoints1, const std::vector<cv::KeyPoint> &keypoints2,
+                                              const FeatureMatches &matches, float threshold, const RansacOptions &options)
+{
+    return estimateHomographySweep(keypoints1, keypoints2, matches, {threshold}, options)[0];
+}
+
+std::vector<HomographyEstimation> estimateHomographySweep(const std::vector<cv::KeyPoint> &keypoints1, const std::vector<cv::KeyPoint> &keypoints2,
+                                                          const FeatureMatches &matches, const std::vector<float> &thresholds,
+                                                          const RansacOptions &options)
+{
+    const int n = static_cast<int>(matches.matches.size());
+    checkSweepInput(thresholds);
+    if (n < 4)
+        return emptySweep(thresholds.size());
+    ScopedTimer timer("estimateHomographySweep", "homography");
+
+    auto estimationStart = std::chrono::high_resolution_clock::now();
+    const Correspondences c = gatherCorrespondences(
+        n, options.prosac, [&](int i) { return matches.matches[i].distance; },
+        [&](int i, float &x1, float &y1, float &x2, float &y2)
+        {
+            const cv::DMatch &match = matches.matches[i];
+            x1 = keypoints1[match.queryIdx].pt.x;
+            y1 = keypoints1[match.queryIdx].pt.y;
+            x2 = keypoints2[match.trainIdx].pt.x;
+            y2 = keypoints2[match.trainIdx].pt.y;
+        });
+    return runSweep(c, thresholds, options, estimationStart);
+}
+
+HomographyEstimation estimateHomographyRansac(const FeatureSet &features1, const FeatureSet &features2, const MatchSet &matches, float threshold,
+                                              const RansacOptions &options)
+{
+    return estimateHomographySweep(features1, features2, matches, {threshold}, options)[0];
+}
+
+std::vector<HomographyEstimation> estimateHomographySweep(const FeatureSet &features1, const FeatureSet &features2, const MatchSet &matches,
+                                                          const std::vector<float> &thresholds, const RansacOptions &options)
+{
+    const int n = static_cast<int>(matches.pairs.size());
+    checkSweepInput(thresholds);
+    if (n < 4)
+        return emptySweep(thresholds.size());
+    ScopedTimer timer("estimateHomographySweep", "homography");
+
+    auto estimationStart = std::chrono::high_resolution_clock::now();
+    const Correspondences c = gatherCorrespondences(
+        n, options.prosac, [&](int i) { return matches.pairs[i].distance; },
+        [&](int i, float &x1, float &y1, float &x2, float &y2)
+        {
+            const MatchPair &pair = matches.pairs[i];
+            x1 = features1.x[pair.query];
+            y1 = features1.y[pair.query];
+            x2 = features2.x[pair.train];
+            y2 = features2.y[pair.train];
+        });
+    return runSweep(c, thresholds, options, estimationStart);
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <opencv2/opencv.hpp>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "featureDetection.h"
+#include "warping.h"
+
+// Cost of a hypothesis from the squared reprojection errors of all correspondences, lower is better
+class RansacScorer {
+public:
+    virtual ~RansacScorer() = default;
+    virtual double cost(const float *squaredResiduals, int count, float squaredThreshold) const = 0;
+};
+
+// Classic RANSAC: number of outliers
+class InlierCountScorer : public RansacScorer {
+public:
+    double cost(const float *squaredResiduals, int count, float squaredThreshold) const override;
+};
+
+// MSAC: truncated quadratic loss, separates hypotheses with the same inlier count
+class MsacScorer : public RansacScorer {
+public:
+    double cost(const float *squaredResiduals, int count, float squaredThreshold) const override;
+};
+
+enum class RansacRefinement {
+    // least-squares refit on the final inliers only
+    NONE,
+    // LO-RANSAC: iterated least squares on the inliers every time a new best model is found
+    LOCAL_OPTIMIZATION,
+    // MAGSAC++-style sigma consensus, approximated by iteratively reweighted least squares
+    MAGSAC
+};
+
+struct RansacOptions {
+    double confidence = 0.995;
+    int maxIterations = 2000;
+    // hypotheses generated and scored in parallel before the stopping criterion is re-evaluated
+    int batchSize = 64;
+    // sample from progressively larger sets of the best matches by descriptor distance
+    bool prosac = true;
+    // Wald's sequential probability ratio test to abandon bad hypotheses early
+    bool sprt = true;
+    RansacRefinement refinement = RansacRefinement::LOCAL_OPTIMIZATION;
+    // defaults to MsacScorer
+    std::shared_ptr<const RansacScorer> scorer;
+    std::uint64_t seed = 0x5eed;
+};
+
+// Drop-in alternative to estimateHomography (same point order and direction, and the same empty H with no
+// inliers when the matches determine no homography) with its own parallel RANSAC. Fills iterations and
+// timePerIterationUs in addition to the usual fields.
+HomographyEstimation estimateHomographyRansac(const std::vector<cv::KeyPoint> &keypoints1, const std::vector<cv::KeyPoint> &keypoints2,
+                                              const FeatureMatches &matches, float threshold, const RansacOptions &options = RansacOptions());
+
+// Parameter study over several reprojection thresholds from a single RANSAC run: every hypothesis is
+// projected once and the shared residuals are scored at each threshold. Returns one estimation per
+// threshold in the given order, each charged an equal share of the sampling time plus its own refinement;
+// timePerIterationUs is the full sampling time per iteration, identical across thresholds.
+std::vector<HomographyEstimation> estimateHomographySweep(const std::vector<cv::KeyPoint> &keypoints1, const std::vector<cv::KeyPoint> &keypoints2,
+                                                          const FeatureMatches &matches, const std::vector<float> &thresholds,
+                                                          const RansacOptions &options = RansacOptions());
+
+// Same as above on the structure-of-arrays containers, gathering positions straight from their x/y arrays
+HomographyEstimation estimateHomographyRansac(const FeatureSet &features1, const FeatureSet &features2, const MatchSet &matches, float threshold,
+                                              const RansacOptions &options = RansacOptions());
+std::vector<HomographyEstimation> estimateHomographySweep(const FeatureSet &features1, const FeatureSet &features2, const MatchSet &matches,
+                                                          const std::vector<float> &thresholds, const RansacOptions &options = RansacOptions());
@@ -0,0 +1,223 @@
+#include <algorithm>
+#include <stdexcept>
+#include <taskGraph.h>
+
+// Pool and queue index of the calling thread, so tasks submitted from a worker land on its own deque
+static thread_local const ThreadPool *currentPool = nullptr;
+static thread_local unsigned currentIndex = 0;
+
+ThreadPool::ThreadPool(unsigned numThreads)
+    : queued(0), nextQueue(0), stopping(false)
+{
+    if (numThreads == 0)
+    {
+        numThreads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (unsigned i = 0; i < numThreads; ++i)
+    {
+        queues.push_back(std::make_unique<WorkQueue>());
+    }
+    for (unsigned i = 0; i < numThreads; ++i)
+    {
+        workers.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+}
+
+void ThreadPool::submit(std::function<void()> task)
+{
+    unsigned index = currentPool == this ? currentIndex : nextQueue++ % queues.size();
+    // Count the task before it becomes visible, so a worker popping it never sees the counter underflow
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        ++queued;
+    }
+    {
+        std::lock_guard<std::mutex> lock(queues[index]->mutex);
+        queues[index]->tasks.push_back(std::move(task));
+    }
+    wake.notify_one();
+}
+
+bool ThreadPool::tryPop(unsigned index, std::function<void()> &task)
+{
+    std::lock_guard<std::mutex> lock(queues[index]->mutex);
+    if (queues[index]->tasks.empty())
+        return false;
+    task = std::move(queues[index]->tasks.back());
+    queues[index]->tasks.pop_back();
+    return true;
+}
+
+bool ThreadPool::trySteal(unsigned thief, std::function<void()> &task)
+{
+    for (unsigned offset = 1; offset < queues.size(); ++offset)
+    {
+        WorkQueue &victim = *queues[(thief + offset) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty())
+        {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::workerLoop(unsigned index)
+{
+    currentPool = this;
+    currentIndex = index;
+
+    while (true)
+    {
+        std::function<void()> task;
+        if (tryPop(index, task) || trySteal(index, task))
+        {
+            --queued;
+            task();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        wake.wait(lock, [this] { return stopping || queued > 0; });
+        if (stopping && queued == 0)
+            return;
+    }
+}
+
+int TaskGraph::add(const std::string &stage, std::function<void()> task, const std::vector<int> &dependencies)
+{
+    const int id = static_cast<int>(nodes.size());
+    auto node = std::make_unique<Node>();
+    node->stage = stage;
+    node->task = std::move(task);
+    node->numDependencies = static_cast<int>(dependencies.size());
+    for (int dependency : dependencies)
+    {
+        if (dependency < 0 || dependency >= id)
+            throw std::invalid_argument("Task dependency must refer to a previously added task");
+        nodes[dependency]->successors.push_back(id);
+    }
+    nodes.push_back(std::move(node));
+
+    if (std::find(stageOrder.begin(), stageOrder.end(), stage) == stageOrder.end())
+    {
+        stageOrder.push_back(stage);
+        records.emplace_back();
+    }
+    return id;
+}
+
+void TaskGraph::execute(ThreadPool &pool, int id)
+{
+    Node &node = *nodes[id];
+    const std::size_t depth = pool.queueDepth();
+    auto start = std::chrono::high_resolution_clock::now();
+
+    bool failed;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        failed = static_cast<bool>(failure);
+    }
+    // Once a task has failed the remaining tasks are only drained, not run
+    if (!failed)
+    {
+        try
+        {
+            node.task();
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!failure)
+                failure = std::current_exception();
+        }
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+
+    for (int successor : node.successors)
+    {
+        if (--nodes[successor]->pending == 0)
+        {
+            pool.submit([this, &pool, successor] { execute(pool, successor); });
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    const std::size_t stageIndex = std::find(stageOrder.begin(), stageOrder.end(), node.stage) - stageOrder.begin();
+    StageRecord &record = records[stageIndex];
+    if (record.numTasks == 0 || start < record.firstStart)
+        record.firstStart = start;
+    if (record.numTasks == 0 || end > record.lastEnd)
+        record.lastEnd = end;
+    ++record.numTasks;
+    record.busyTimeMs += std::chrono::duration<double, std::milli>(end - start).count();
+    record.maxQueueDepth = std::max(record.maxQueueDepth, depth);
+    record.summedQueueDepth += depth;
+
+    if (--remaining == 0)
+        done.notify_all();
+}
+
+void TaskGraph::run(ThreadPool &pool)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        remaining = static_cast<int>(nodes.size());
+        failure = nullptr;
+        for (auto &record : records)
+            record = StageRecord();
+    }
+    if (nodes.empty())
+        return;
+
+    for (auto &node : nodes)
+    {
+        node->pending = node->numDependencies;
+    }
+    for (int id = 0; id < static_cast<int>(nodes.size()); ++id)
+    {
+        if (nodes[id]->numDependencies == 0)
+        {
+            pool.submit([this, &pool, id] { execute(pool, id); });
+        }
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [this] { return remaining == 0; });
+    if (failure)
+        std::rethrow_exception(failure);
+}
+
+std::vector<StageMetrics> TaskGraph::stageMetrics() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<StageMetrics> metrics;
+    for (std::size_t i = 0; i < stageOrder.size(); ++i)
+    {
+        const StageRecord &record = records[i];
+        StageMetrics stage;
+        stage.stage = stageOrder[i];
+        stage.numTasks = record.numTasks;
+        stage.wallTimeMs = record.numTasks > 0 ? std::chrono::duration<double, std::milli>(record.lastEnd - record.firstStart).count() : 0.0;
+        stage.busyTimeMs = record.busyTimeMs;
+        stage.maxQueueDepth = record.maxQueueDepth;
+        stage.meanQueueDepth = record.numTasks > 0 ? static_cast<double>(record.summedQueueDepth) / record.numTasks : 0.0;
+        metrics.push_back(stage);
+    }
+    return metrics;
+}
@@ -0,0 +1,92 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Fixed-size pool where every worker owns a task deque. Workers pop their own newest task first and
+// steal the oldest task of another worker when idle, so tasks spawned by a task stay on the same core.
+class ThreadPool {
+public:
+    explicit ThreadPool(unsigned numThreads = 0);
+    ~ThreadPool();
+
+    void submit(std::function<void()> task);
+    std::size_t queueDepth() const { return queued.load(); }
+    unsigned size() const { return static_cast<unsigned>(workers.size()); }
+
+private:
+    struct WorkQueue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    bool tryPop(unsigned index, std::function<void()> &task);
+    bool trySteal(unsigned thief, std::function<void()> &task);
+    void workerLoop(unsigned index);
+
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+    std::vector<std::thread> workers;
+    std::atomic<std::size_t> queued;
+    std::atomic<unsigned> nextQueue;
+    std::atomic<bool> stopping;
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+};
+
+struct StageMetrics {
+    std::string stage;
+    int numTasks;
+    // first task start to last task end
+    double wallTimeMs;
+    // summed task durations
+    double busyTimeMs;
+    // pool queue depth observed when the stage's tasks started
+    std::size_t maxQueueDepth;
+    double meanQueueDepth;
+};
+
+// Dependency graph of tasks grouped into named stages. A task is submitted to the pool as soon as
+// all of its dependencies have finished, so independent stages of different items overlap.
+class TaskGraph {
+public:
+    int add(const std::string &stage, std::function<void()> task, const std::vector<int> &dependencies = {});
+
+    // Blocks until every task has run; rethrows the first exception thrown by a task
+    void run(ThreadPool &pool);
+    std::vector<StageMetrics> stageMetrics() const;
+
+private:
+    struct Node {
+        std::string stage;
+        std::function<void()> task;
+        std::vector<int> successors;
+        int numDependencies = 0;
+        std::atomic<int> pending{0};
+    };
+
+    struct StageRecord {
+        int numTasks = 0;
+        double busyTimeMs = 0.0;
+        std::size_t maxQueueDepth = 0;
+        std::size_t summedQueueDepth = 0;
+        std::chrono::high_resolution_clock::time_point firstStart, lastEnd;
+    };
+
+    void execute(ThreadPool &pool, int id);
+
+    std::vector<std::unique_ptr<Node>> nodes;
+    std::vector<std::string> stageOrder;
+    std::vector<StageRecord> records;
+
+    mutable std::mutex mutex;
+    std::condition_variable done;
+    int remaining = 0;
+    std::exception_ptr failure;
+};
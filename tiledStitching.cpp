@@ -0,0 +1,149 @@
+#include <opencv2/opencv.hpp>
+#include <atomic>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <tiledStitching.h>
+
+// Corners of image2 projected into image1 coordinates
+static std::vector<cv::Point2f> projectedCorners(const cv::Mat &image2, const cv::Mat &H)
+{
+    const float w = static_cast<float>(image2.cols), h = static_cast<float>(image2.rows);
+    std::vector<cv::Point2f> corners = {{0, 0}, {w, 0}, {w, h}, {0, h}}, projected;
+    cv::perspectiveTransform(corners, projected, H);
+    return projected;
+}
+
+// Columns [minX, maxX] where image1 and the projected image2 intersect, computed from the geometry
+// so it is known before any tile is warped. minX > maxX when they do not overlap.
+static void geometricOverlapExtent(const cv::Mat &image1, const std::vector<cv::Point2f> &quad, int &minX, int &maxX)
+{
+    std::vector<cv::Point2f> rect = {{0, 0}, {static_cast<float>(image1.cols), 0},
+                                     {static_cast<float>(image1.cols), static_cast<float>(image1.rows)}, {0, static_cast<float>(image1.rows)}};
+    std::vector<cv::Point2f> intersection;
+    minX = std::numeric_limits<int>::max();
+    maxX = 0;
+    if (cv::intersectConvexConvex(rect, quad, intersection) <= 0.0f)
+        return;
+
+    float lo = intersection[0].x, hi = intersection[0].x;
+    for (const auto &p : intersection)
+    {
+        lo = std::min(lo, p.x);
+        hi = std::max(hi, p.x);
+    }
+    minX = std::max(0, static_cast<int>(std::floor(lo)));
+    maxX = std::min(image1.cols - 1, static_cast<int>(std::ceil(hi)) - 1);
+}
+
+TiledStitchingResult stitchImagesTiled(const cv::Mat &image1, const cv::Mat &image2, const cv::Mat &H, const std::string &outputDirectory,
+                                       const TiledStitchingOptions &options)
+{
+    CV_Assert(image1.type() == CV_8UC3 && image2.type() == CV_8UC3 && options.tileSize > 0);
+    auto start = std::chrono::high_resolution_clock::now();
+
+    // Bounds of image1 and the projected image2 replace the fixed (w1 + w2) x max(h1, h2) canvas
+    std::vector<cv::Point2f> quad = projectedCorners(image2, H);
+    float minXf = 0.0f, minYf = 0.0f, maxXf = static_cast<float>(image1.cols), maxYf = static_cast<float>(image1.rows);
+    for (const auto &corner : quad)
+    {
+        minXf = std::min(minXf, corner.x);
+        minYf = std::min(minYf, corner.y);
+        maxXf = std::max(maxXf, corner.x);
+        maxYf = std::max(maxYf, corner.y);
+    }
+    const double inputArea = static_cast<double>(image1.total() + image2.total());
+    const double boundsArea = static_cast<double>(maxXf - minXf) * (maxYf - minYf);
+    // A near-singular homography projects corners towards infinity
+    if (!std::isfinite(boundsArea) || boundsArea > 16.0 * inputArea)
+    {
+        throw std::runtime_error("Degenerate homography, the panorama bounds are unbounded");
+    }
+
+    TiledStitchingResult result;
+    const int originX = static_cast<int>(std::floor(minXf)), originY = static_cast<int>(std::floor(minYf));
+    result.bounds = cv::Rect(originX, originY, static_cast<int>(std::ceil(maxXf)) - originX, static_cast<int>(std::ceil(maxYf)) - originY);
+    result.tilesX = (result.bounds.width + options.tileSize - 1) / options.tileSize;
+    result.tilesY = (result.bounds.height + options.tileSize - 1) / options.tileSize;
+
+    int overlapMinX, overlapMaxX;
+    geometricOverlapExtent(image1, quad, overlapMinX, overlapMaxX);
+    if (overlapMinX > overlapMaxX)
+    {
+        // Without overlap both weights are 1 everywhere
+        overlapMinX = std::numeric_limits<int>::max();
+        overlapMaxX = 0;
+    }
+
+    std::filesystem::create_directories(outputDirectory);
+    cv::Mat H64;
+    H.convertTo(H64, CV_64F);
+    const cv::Rect image1Rect(0, 0, image1.cols, image1.rows);
+
+    std::atomic<size_t> liveBytes(0), peakBytes(0);
+    cv::parallel_for_(cv::Range(0, result.tilesX * result.tilesY), [&](const cv::Range &range)
+    {
+        for (int index = range.start; index < range.end; ++index)
+        {
+            const int row = index / result.tilesX, col = index % result.tilesX;
+            // Tile rectangle in image1 coordinates
+            cv::Rect tileRect(result.bounds.x + col * options.tileSize, result.bounds.y + row * options.tileSize, options.tileSize, options.tileSize);
+            tileRect &= result.bounds;
+
+            const size_t tileBytes = 2 * static_cast<size_t>(tileRect.area()) * 3;
+            size_t live = liveBytes += tileBytes;
+            size_t peak = peakBytes.load();
+            while (live > peak && !peakBytes.compare_exchange_weak(peak, live))
+            {
+            }
+
+            cv::Mat shift = (cv::Mat_<double>(3, 3) << 1, 0, -tileRect.x, 0, 1, -tileRect.y, 0, 0, 1);
+            cv::Mat tile;
+            cv::warpPerspective(image2, tile, shift * H64, tileRect.size());
+
+            cv::Mat tile1 = cv::Mat::zeros(tileRect.size(), CV_8UC3);
+            cv::Rect image1Part = tileRect & image1Rect;
+            if (!image1Part.empty())
+            {
+                image1(image1Part).copyTo(tile1(image1Part - tileRect.tl()));
+            }
+
+            switch (options.method)
+            {
+            case StitchingMethod::OVERLAY:
+                if (!image1Part.empty())
+                {
+                    image1(image1Part).copyTo(tile(image1Part - tileRect.tl()));
+                }
+                break;
+            case StitchingMethod::FEATHERING:
+            case StitchingMethod::FEATHERING_LEGACY:
+                // The ramp spans the geometric overlap, shifted into tile columns so every tile sees the same ramp
+                featherBlend(tile1, tile, overlapMinX == std::numeric_limits<int>::max() ? overlapMinX : overlapMinX - tileRect.x, overlapMaxX - tileRect.x);
+                break;
+            default:
+                throw std::invalid_argument("Unknown stitching method");
+            }
+
+            const std::string name = "tile_" + std::to_string(row) + "_" + std::to_string(col) + options.tileExtension;
+            if (!cv::imwrite((std::filesystem::path(outputDirectory) / name).string(), tile))
+            {
+                throw std::runtime_error("Could not write tile " + name);
+            }
+            liveBytes -= tileBytes;
+        }
+    });
+
+    std::ofstream manifest((std::filesystem::path(outputDirectory) / "manifest.txt").string());
+    manifest << "width " << result.bounds.width << "\n"
+             << "height " << result.bounds.height << "\n"
+             << "origin " << result.bounds.x << " " << result.bounds.y << "\n"
+             << "tile_size " << options.tileSize << "\n"
+             << "tiles " << result.tilesX << " " << result.tilesY << "\n"
+             << "pattern tile_<row>_<col>" << options.tileExtension << "\n";
+
+    result.peakTileBytes = peakBytes.load();
+    result.timeMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    return result;
+}
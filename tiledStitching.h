@@ -0,0 +1,30 @@
+#pragma once
+#include <opencv2/opencv.hpp>
+#include <string>
+#include "warping.h"
+
+struct TiledStitchingOptions {
+    int tileSize = 1024;
+    StitchingMethod method = StitchingMethod::FEATHERING;
+    // Any format cv::imwrite supports
+    std::string tileExtension = ".png";
+};
+
+struct TiledStitchingResult {
+    // Panorama extent in image1 coordinates, i.e. tile (0, 0) starts at bounds.tl()
+    cv::Rect bounds;
+    int tilesX;
+    int tilesY;
+    // Lower bound on the tile memory alive at the same time: counts the two tile buffers of every tile in
+    // flight but not the scratch used by warpPerspective or featherBlend
+    size_t peakTileBytes;
+    double timeMs;
+};
+
+// Warp and blend image2 onto image1 without ever allocating the full canvas. The panorama is cropped to
+// image1 plus the projected corners of image2 and produced tile by tile; finished tiles are written to
+// outputDirectory as tile_<row>_<col><extension> next to a manifest.txt describing the layout.
+// Feathering ramps across the columns where image1 and the projected image2 intersect geometrically,
+// whereas stitchImages ramps across the columns with non-zero warped pixels, so seams can differ slightly.
+TiledStitchingResult stitchImagesTiled(const cv::Mat &image1, const cv::Mat &image2, const cv::Mat &H, const std::string &outputDirectory,
+                                       const TiledStitchingOptions &options = TiledStitchingOptions());
@@ -0,0 +1,214 @@
+#include <opencv2/opencv.hpp>
+#include <opencv2/video/tracking.hpp>
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <videoStitching.h>
+
+namespace
+{
+// Homography from stream 2 into stream 1 together with the correspondences that support it
+struct TrackingState
+{
+    cv::Mat H;
+    std::vector<cv::Point2f> points1, points2;
+    cv::Mat previousGray1, previousGray2;
+};
+
+// Keep the correspondences that H maps within the threshold, returns the inlier ratio
+double keepInliers(const cv::Mat &H, std::vector<cv::Point2f> &points1, std::vector<cv::Point2f> &points2, float threshold)
+{
+    if (points2.empty())
+        return 0.0;
+
+    std::vector<cv::Point2f> projected;
+    cv::perspectiveTransform(points2, projected, H);
+    size_t kept = 0;
+    for (size_t i = 0; i < points2.size(); ++i)
+    {
+        if (cv::norm(projected[i] - points1[i]) < threshold)
+        {
+            points1[kept] = points1[i];
+            points2[kept] = points2[i];
+            ++kept;
+        }
+    }
+    const double ratio = static_cast<double>(kept) / points2.size();
+    points1.resize(kept);
+    points2.resize(kept);
+    return ratio;
+}
+
+void redetect(const cv::Mat &frame1, const cv::Mat &frame2, const StreamingOptions &options, TrackingState &state)
+{
+    FeatureSet features1 = extract_feature_set(frame1, options.method);
+    FeatureSet features2 = extract_feature_set(frame2, options.method);
+    // The previous H is still roughly right when the tracks degrade, so it guides the search
+    MatchSet matches;
+    if (!state.H.empty() && options.guidedRadius > 0.0f)
+    {
+        GuidedMatchOptions guided;
+        guided.radius = options.guidedRadius;
+        matches = match_feature_sets_guided(features2, features1, cv::Matx33d(state.H), guided);
+    }
+    // Too little support means the view moved beyond the radius, match globally instead
+    if (static_cast<int>(matches.pairs.size()) < options.minTrackedPoints)
+        matches = match_feature_sets(features2, features1);
+    HomographyEstimation estimation = estimateHomography(features2, features1, matches, options.threshold);
+    if (estimation.H.empty())
+        return;
+
+    state.H = estimation.H;
+    state.points1.resize(matches.pairs.size());
+    state.points2.resize(matches.pairs.size());
+    for (size_t i = 0; i < matches.pairs.size(); ++i)
+    {
+        const MatchPair &pair = matches.pairs[i];
+        state.points2[i] = cv::Point2f(features2.x[pair.query], features2.y[pair.query]);
+        state.points1[i] = cv::Point2f(features1.x[pair.train], features1.y[pair.train]);
+    }
+    keepInliers(state.H, state.points1, state.points2, options.threshold);
+}
+
+// Follow the tracked points into the new frames, dropping any that either stream loses
+void track(const cv::Mat &gray1, const cv::Mat &gray2, TrackingState &state)
+{
+    if (state.points1.empty())
+        return;
+
+    std::vector<cv::Point2f> next1, next2;
+    std::vector<uchar> status1, status2;
+    std::vector<float> error;
+    cv::calcOpticalFlowPyrLK(state.previousGray1, gray1, state.points1, next1, status1, error);
+    cv::calcOpticalFlowPyrLK(state.previousGray2, gray2, state.points2, next2, status2, error);
+
+    size_t kept = 0;
+    for (size_t i = 0; i < next1.size(); ++i)
+    {
+        if (status1[i] && status2[i])
+        {
+            state.points1[kept] = next1[i];
+            state.points2[kept] = next2[i];
+            ++kept;
+        }
+    }
+    state.points1.resize(kept);
+    state.points2.resize(kept);
+}
+
+double percentile(const std::vector<double> &sorted, double p)
+{
+    if (sorted.empty())
+        return 0.0;
+    size_t rank = static_cast<size_t>(std::ceil(p * sorted.size()));
+    return sorted[std::min(sorted.size(), std::max<size_t>(rank, 1)) - 1];
+}
+}
+
+StreamingStats stitchVideoStreams(cv::VideoCapture &stream1, cv::VideoCapture &stream2, cv::VideoWriter *output, const StreamingOptions &options)
+{
+    StreamingStats stats = {0, 0, 0, 0.0, 0.0, 0.0, 0.0, 0.0};
+    std::vector<double> latencies;
+    TrackingState state;
+    if (options.stitchingMethod == StitchingMethod::FEATHERING_LEGACY)
+    {
+        throw std::invalid_argument("FEATHERING_LEGACY is not supported for streams, which stitch through a warp plan");
+    }
+
+    WarpPlan plan;
+    if (!options.warpPlanPath.empty() && std::filesystem::exists(options.warpPlanPath))
+    {
+        // A stale, corrupt or truncated plan is only a cache miss: start without one and rebuild it from the first H
+        try
+        {
+            plan = loadWarpPlan(options.warpPlanPath);
+        }
+        catch (const std::exception &)
+        {
+            plan = WarpPlan();
+        }
+    }
+    cv::Mat frame1, frame2, gray1, gray2;
+
+    auto streamStart = std::chrono::high_resolution_clock::now();
+    while ((options.maxFrames <= 0 || stats.numFrames < options.maxFrames) && stream1.read(frame1) && stream2.read(frame2))
+    {
+        auto frameStart = std::chrono::high_resolution_clock::now();
+        cv::cvtColor(frame1, gray1, cv::COLOR_BGR2GRAY);
+        cv::cvtColor(frame2, gray2, cv::COLOR_BGR2GRAY);
+
+        bool needsRedetection = state.H.empty();
+        if (!needsRedetection)
+        {
+            track(gray1, gray2, state);
+            const size_t tracked = state.points1.size();
+            const double inlierRatio = keepInliers(state.H, state.points1, state.points2, options.threshold);
+            needsRedetection = inlierRatio < options.minInlierRatio || static_cast<int>(tracked) < options.minTrackedPoints;
+        }
+        if (needsRedetection)
+        {
+            redetect(frame1, frame2, options, state);
+            ++stats.numRedetections;
+        }
+        // Swap instead of copy, cvtColor reuses the old buffers for the next frame
+        std::swap(state.previousGray1, gray1);
+        std::swap(state.previousGray2, gray2);
+
+        if (!state.H.empty())
+        {
+            if (!warpPlanMatches(plan, state.H, frame1.size(), frame2.size(), options.warpPlanTolerancePx))
+            {
+                plan = createWarpPlan(state.H, frame1.size(), frame2.size());
+                ++stats.numPlanRebuilds;
+            }
+            cv::Mat stitched = stitchImages(plan, frame1, frame2, options.stitchingMethod);
+            if (output)
+            {
+                if (!output->isOpened())
+                {
+                    throw std::runtime_error("Output video is not open");
+                }
+                output->write(stitched);
+            }
+        }
+
+        latencies.push_back(std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - frameStart).count());
+        ++stats.numFrames;
+    }
+    double totalMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - streamStart).count();
+
+    // Written once here rather than on every rebuild, so disk I/O stays off the per-frame path
+    if (stats.numPlanRebuilds > 0 && !options.warpPlanPath.empty())
+    {
+        saveWarpPlan(plan, options.warpPlanPath);
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    stats.latencyP50Ms = percentile(latencies, 0.50);
+    stats.latencyP90Ms = percentile(latencies, 0.90);
+    stats.latencyP99Ms = percentile(latencies, 0.99);
+    stats.latencyMaxMs = latencies.empty() ? 0.0 : latencies.back();
+    stats.sustainedFps = totalMs > 0.0 ? stats.numFrames * 1000.0 / totalMs : 0.0;
+    return stats;
+}
+
+StreamingStats stitchVideoFiles(const std::string &path1, const std::string &path2, const std::string &outputPath, const StreamingOptions &options)
+{
+    cv::VideoCapture stream1(path1), stream2(path2);
+    if (!stream1.isOpened() || !stream2.isOpened())
+    {
+        throw std::runtime_error("Could not open the input videos!");
+    }
+
+    cv::VideoWriter writer;
+    if (!outputPath.empty())
+    {
+        // stitchImages always produces a (w1 + w2) x max(h1, h2) canvas
+        const int w1 = static_cast<int>(stream1.get(cv::CAP_PROP_FRAME_WIDTH)), h1 = static_cast<int>(stream1.get(cv::CAP_PROP_FRAME_HEIGHT));
+        const int w2 = static_cast<int>(stream2.get(cv::CAP_PROP_FRAME_WIDTH)), h2 = static_cast<int>(stream2.get(cv::CAP_PROP_FRAME_HEIGHT));
+        double fps = stream1.get(cv::CAP_PROP_FPS);
+        writer.open(outputPath, cv::VideoWriter::fourcc('m', 'p', '4', 'v'), fps > 0 ? fps : 30.0, cv::Size(w1 + w2, std::max(h1, h2)));
+    }
+
+    return stitchVideoStreams(stream1, stream2, outputPath.empty() ? nullptr : &writer, options);
+}
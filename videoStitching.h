@@ -0,0 +1,42 @@
+#pragma once
+#include <opencv2/opencv.hpp>
+#include <string>
+#include "featureDetection.h"
+#include "warping.h"
+
+struct StreamingOptions {
+    FeatureDetectorMethod method = FeatureDetectorMethod::ORB;
+    float threshold = 5.0f;
+    StitchingMethod stitchingMethod = StitchingMethod::FEATHERING;
+    // Re-detect and re-run RANSAC once fewer than this fraction of the tracked points agree with H
+    double minInlierRatio = 0.6;
+    // ... or once fewer than this many tracked correspondences survive
+    int minTrackedPoints = 40;
+    // Re-detections with a previous H only match within this radius of where it maps a keypoint, 0 matches globally
+    float guidedRadius = 24.0f;
+    // 0 processes the streams to their end
+    int maxFrames = 0;
+    // The warp plan is rebuilt once H moves a corner of frame 2 by more than this many pixels. Re-estimated
+    // homographies of a fixed rig jitter by a pixel or so, which the blend hides.
+    double warpPlanTolerancePx = 2.0;
+    // Warp plan reloaded on start and written back when the stream ends if it was rebuilt, empty to keep it in memory only
+    std::string warpPlanPath;
+};
+
+struct StreamingStats {
+    int numFrames;
+    int numRedetections;
+    int numPlanRebuilds;
+    double latencyP50Ms;
+    double latencyP90Ms;
+    double latencyP99Ms;
+    double latencyMaxMs;
+    double sustainedFps;
+};
+
+// Stitch two synchronized streams frame by frame. The homography and its inlier correspondences are
+// carried from frame to frame with pyramidal Lucas-Kanade optical flow; full feature extraction,
+// matching and RANSAC only run on the first frame and whenever the tracked inlier ratio drops.
+// Frames are warped through a cached WarpPlan that is only rebuilt when H moves noticeably.
+StreamingStats stitchVideoStreams(cv::VideoCapture &stream1, cv::VideoCapture &stream2, cv::VideoWriter *output, const StreamingOptions &options = StreamingOptions());
+StreamingStats stitchVideoFiles(const std::string &path1, const std::string &path2, const std::string &outputPath, const StreamingOptions &options = StreamingOptions());
@@ -1,53 +1,138 @@
 #include <opencv2/opencv.hpp>
-#include <featureDetection.h>
+#include <opencv2/core/hal/intrin.hpp>
+#include <cfloat>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <warping.h>
+#include <featureCache.h>
+#include <profiler.h>
+#include <pipelineContext.h>
 
-struct HomographyEstimation
+// Inliers, estimation time and alignment error under the calling thread's profiler label
+void recordEstimationMetrics(const HomographyEstimation &estimation)
 {
-    cv::Mat H;
-    int numInliers;
-    float estimationTimeMs;
-    float alignmentError;
-};
+    Profiler &profiler = Profiler::instance();
+    profiler.addCounter("inliers", estimation.numInliers);
+    profiler.recordMetric("inliers", estimation.numInliers);
+    profiler.recordMetric("estimation_ms", estimation.estimationTimeMs);
+    profiler.recordMetric("alignment_error", estimation.alignmentError);
+}
 
-HomographyEstimation estimateHomography(std::vector<cv::KeyPoint> keypoints1, std::vector<cv::KeyPoint> keypoints2, FeatureMatches matches, float threshold)
+// An empty H with no inliers and an infinite alignment error when there are fewer than 4 correspondences or
+// findHomography finds no model, so callers can keep a previous estimate instead of catching
+static HomographyEstimation estimateFromPoints(const std::vector<cv::Point2f> &points1, const std::vector<cv::Point2f> &points2, float threshold,
+                                               cv::Mat mask = cv::Mat())
 {
     HomographyEstimation result;
+    // findHomography does not expose its iteration count
+    result.iterations = 0;
+    result.timePerIterationUs = 0.0f;
+
+    auto estimationStart = std::chrono::high_resolution_clock::now();
+    if (points1.size() >= 4)
+    {
+        try
+        {
+            result.H = cv::findHomography(points1, points2, cv::RANSAC, threshold, mask);
+        }
+        catch (const cv::Exception &)
+        {
+            result.H.release();
+        }
+    }
+    auto estimationEnd = std::chrono::high_resolution_clock::now();
+    result.estimationTimeMs = std::chrono::duration<float, std::milli>(estimationEnd - estimationStart).count();
+
+    if (result.H.empty())
+    {
+        result.numInliers = 0;
+        result.alignmentError = std::numeric_limits<float>::infinity();
+    }
+    else
+    {
+        result.numInliers = cv::countNonZero(mask);
+        result.alignmentError = computeAlignmentError(points1, points2, result.H);
+    }
+    recordEstimationMetrics(result);
+
+    return result;
+}
+
+HomographyEstimation estimateHomography(const std::vector<cv::KeyPoint> &keypoints1, const std::vector<cv::KeyPoint> &keypoints2, const FeatureMatches &matches, float threshold)
+{
+    ScopedTimer timer("estimateHomography", "homography");
 
     std::vector<cv::Point2f> points1, points2;
+    points1.reserve(matches.matches.size());
+    points2.reserve(matches.matches.size());
     for (const auto &match : matches.matches)
     {
         points1.push_back(keypoints1[match.queryIdx].pt);
         points2.push_back(keypoints2[match.trainIdx].pt);
     }
 
-    auto mask = cv::Mat();
+    return estimateFromPoints(points1, points2, threshold);
+}
 
-    auto estimationStart = std::chrono::high_resolution_clock::now();
-    result.H = cv::findHomography(points1, points2, cv::RANSAC, threshold, mask);
-    auto estimationEnd = std::chrono::high_resolution_clock::now();
-    result.estimationTimeMs = std::chrono::duration<float, std::milli>(estimationEnd - estimationStart).count();
+HomographyEstimation estimateHomography(const FeatureSet &features1, const FeatureSet &features2, const MatchSet &matches, float threshold,
+                                        PipelineContext &context)
+{
+    ScopedTimer timer("estimateHomography", "homography");
 
-    result.numInliers = cv::countNonZero(mask);
+    const size_t count = matches.pairs.size();
+    context.points1.resize(count);
+    context.points2.resize(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        const MatchPair &pair = matches.pairs[i];
+        context.points1[i] = cv::Point2f(features1.x[pair.query], features1.y[pair.query]);
+        context.points2[i] = cv::Point2f(features2.x[pair.train], features2.y[pair.train]);
+    }
 
-    double totalError = 0.0;
-    std::vector<cv::Point2f> projectedPoints;
-    cv::perspectiveTransform(points2, projectedPoints, result.H);
-    for (size_t i = 0; i < points1.size(); ++i)
+    cv::Mat mask = acquireBuffer(context.inlierMask, cv::Size(1, static_cast<int>(count)), CV_8U);
+    return estimateFromPoints(context.points1, context.points2, threshold, mask);
+}
+
+HomographyEstimation estimateHomography(const FeatureSet &features1, const FeatureSet &features2, const MatchSet &matches, float threshold)
+{
+    ScopedTimer timer("estimateHomography", "homography");
+
+    // Gathered straight from the coordinate arrays into buffers sized once
+    const size_t count = matches.pairs.size();
+    std::vector<cv::Point2f> points1(count), points2(count);
+    const float *x1 = features1.x.data(), *y1 = features1.y.data();
+    const float *x2 = features2.x.data(), *y2 = features2.y.data();
+    for (size_t i = 0; i < count; ++i)
     {
-        double dx = projectedPoints[i].x - points2[i].x;
-        double dy = projectedPoints[i].y - points2[i].y;
-        totalError += abs(dx) + abs(dy);
+        const MatchPair &pair = matches.pairs[i];
+        points1[i] = cv::Point2f(x1[pair.query], y1[pair.query]);
+        points2[i] = cv::Point2f(x2[pair.train], y2[pair.train]);
     }
-    result.alignmentError = totalError / points1.size();
 
-    return result;
+    return estimateFromPoints(points1, points2, threshold);
 }
 
-enum class StitchingMethod
+float computeAlignmentError(const std::vector<cv::Point2f> &points1, const std::vector<cv::Point2f> &points2, const cv::Mat &H)
 {
-    OVERLAY,
-    FEATHERING
-};
+    // Projects point by point like cv::perspectiveTransform, without a buffer for the projected points
+    const cv::Matx33d M(H);
+    double totalError = 0.0;
+    for (size_t i = 0; i < points1.size(); ++i)
+    {
+        const cv::Point2f &p = points1[i];
+        double w = M(2, 0) * p.x + M(2, 1) * p.y + M(2, 2);
+        w = std::abs(w) > FLT_EPSILON ? 1.0 / w : 0.0;
+        const float projectedX = static_cast<float>((M(0, 0) * p.x + M(0, 1) * p.y + M(0, 2)) * w);
+        const float projectedY = static_cast<float>((M(1, 0) * p.x + M(1, 1) * p.y + M(1, 2)) * w);
+        double dx = projectedX - points2[i].x;
+        double dy = projectedY - points2[i].y;
+        totalError += abs(dx) + abs(dy);
+    }
+    return totalError / points1.size();
+}
 
 // blend linearly only in overlap region
 float d1(int x, int overlapStart, int overlapEnd)
@@ -66,7 +151,305 @@ float d2(int x, int overlapStart, int overlapEnd)
         return static_cast<float>(x - overlapStart) / (overlapEnd - overlapStart);
 };
 
-cv::Mat stitchImages(cv::Mat image1, cv::Mat image2, cv::Mat H, StitchingMethod method = StitchingMethod::OVERLAY)
+// Stage duration in ms, also recorded as a profiler span
+static double elapsedMs(const char *stage, std::chrono::high_resolution_clock::time_point start)
+{
+    auto end = std::chrono::high_resolution_clock::now();
+    Profiler::instance().recordSpan(stage, "stitching", start, end);
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+// Horizontal extent [minX, maxX] of the pixels that are non-zero in both image1 and the warped image2.
+// Only image1's rectangle can overlap, so just that region is scanned, one row per task.
+static void findOverlapExtent(const cv::Mat &image1, const cv::Mat &warped, int &minX, int &maxX, BlendScratch &scratch)
+{
+    const int rows = std::min(image1.rows, warped.rows);
+    const int cols = std::min(image1.cols, warped.cols);
+    std::vector<int> &rowMin = scratch.rowMin, &rowMax = scratch.rowMax;
+    rowMin.assign(rows, warped.cols);
+    rowMax.assign(rows, 0);
+
+    cv::parallel_for_(cv::Range(0, rows), [&](const cv::Range &range)
+    {
+        for (int y = range.start; y < range.end; ++y)
+        {
+            const uchar *p1 = image1.ptr<uchar>(y);
+            const uchar *p2 = warped.ptr<uchar>(y);
+            auto overlaps = [&](int x)
+            {
+                const uchar *a = p1 + 3 * x;
+                const uchar *b = p2 + 3 * x;
+                return (a[0] | a[1] | a[2]) && (b[0] | b[1] | b[2]);
+            };
+
+            int x = 0;
+            while (x < cols && !overlaps(x))
+                ++x;
+            if (x == cols)
+                continue;
+            rowMin[y] = x;
+
+            x = cols - 1;
+            while (!overlaps(x))
+                --x;
+            rowMax[y] = x;
+        }
+    });
+
+    minX = warped.cols;
+    maxX = 0;
+    for (int y = 0; y < rows; ++y)
+    {
+        minX = std::min(minX, rowMin[y]);
+        maxX = std::max(maxX, rowMax[y]);
+    }
+}
+
+#if CV_SIMD
+// saturate(round(src[i] * weights[i])) for one vector of bytes
+static inline cv::v_uint8 scaleRound(const uchar *src, const float *weights)
+{
+    const int n = cv::v_float32::nlanes;
+    cv::v_uint16 lo, hi;
+    cv::v_expand(cv::vx_load(src), lo, hi);
+    cv::v_uint32 q0, q1, q2, q3;
+    cv::v_expand(lo, q0, q1);
+    cv::v_expand(hi, q2, q3);
+    cv::v_int32 r0 = cv::v_round(cv::v_cvt_f32(cv::v_reinterpret_as_s32(q0)) * cv::vx_load(weights));
+    cv::v_int32 r1 = cv::v_round(cv::v_cvt_f32(cv::v_reinterpret_as_s32(q1)) * cv::vx_load(weights + n));
+    cv::v_int32 r2 = cv::v_round(cv::v_cvt_f32(cv::v_reinterpret_as_s32(q2)) * cv::vx_load(weights + 2 * n));
+    cv::v_int32 r3 = cv::v_round(cv::v_cvt_f32(cv::v_reinterpret_as_s32(q3)) * cv::vx_load(weights + 3 * n));
+    return cv::v_pack_u(cv::v_pack(r0, r1), cv::v_pack(r2, r3));
+}
+#endif
+
+// Blend image1 into the warped canvas in place: out = image1 * d1(x) + warped * d2(x).
+// The weights only depend on the column, so they are computed once and expanded to one entry per channel byte.
+// Rounding and saturation follow Vec3b * float + Vec3b, so the result matches the legacy path exactly.
+void featherBlend(const cv::Mat &image1, cv::Mat &warped, int minX, int maxX, BlendScratch &scratch)
+{
+    const int rowBytes = warped.cols * 3;
+    // resize() keeps the capacity, so the weight rows are only allocated when the canvas grows
+    std::vector<float> &weights1 = scratch.featherWeights1;
+    std::vector<float> &weights2 = scratch.featherWeights2;
+    weights1.resize(rowBytes);
+    weights2.resize(rowBytes);
+    for (int x = 0; x < warped.cols; ++x)
+    {
+        float w1 = d1(x, minX, maxX);
+        float w2 = d2(x, minX, maxX);
+        for (int c = 0; c < 3; ++c)
+        {
+            weights1[3 * x + c] = w1;
+            weights2[3 * x + c] = w2;
+        }
+    }
+
+    cv::parallel_for_(cv::Range(0, warped.rows), [&](const cv::Range &range)
+    {
+        for (int y = range.start; y < range.end; ++y)
+        {
+            uchar *out = warped.ptr<uchar>(y);
+            const uchar *in = y < image1.rows ? image1.ptr<uchar>(y) : nullptr;
+            const int image1Bytes = in ? image1.cols * 3 : 0;
+
+            int i = 0;
+#if CV_SIMD
+            const int step = cv::v_uint8::nlanes;
+            for (; i <= image1Bytes - step; i += step)
+            {
+                cv::v_uint8 blended = scaleRound(in + i, weights1.data() + i) + scaleRound(out + i, weights2.data() + i);
+                cv::v_store(out + i, blended);
+            }
+#endif
+            for (; i < image1Bytes; ++i)
+            {
+                out[i] = cv::saturate_cast<uchar>(cv::saturate_cast<uchar>(in[i] * weights1[i]) + cv::saturate_cast<uchar>(out[i] * weights2[i]));
+            }
+            for (; i < rowBytes; ++i)
+            {
+                out[i] = cv::saturate_cast<uchar>(out[i] * weights2[i]);
+            }
+        }
+    });
+}
+
+void featherBlend(const cv::Mat &image1, cv::Mat &warped, int minX, int maxX)
+{
+    static thread_local BlendScratch threadScratch;
+    featherBlend(image1, warped, minX, maxX, threadScratch);
+}
+
+// 255 where any channel of a CV_8UC3 image is non-zero, the same criterion the feathering overlap uses
+static cv::Mat nonZeroMask(const cv::Mat &image, cv::Mat &storage)
+{
+    cv::Mat mask = acquireBuffer(storage, image.size(), CV_8U);
+    cv::parallel_for_(cv::Range(0, image.rows), [&](const cv::Range &range)
+    {
+        for (int y = range.start; y < range.end; ++y)
+        {
+            const uchar *p = image.ptr<uchar>(y);
+            uchar *m = mask.ptr<uchar>(y);
+            for (int x = 0; x < image.cols; ++x)
+            {
+                m[x] = (p[3 * x] | p[3 * x + 1] | p[3 * x + 2]) ? 255 : 0;
+            }
+        }
+    });
+    return mask;
+}
+
+// Every level is a view of storage kept from call to call, so stitches of the same or a smaller size do not reallocate
+static void buildGaussianPyramid(const cv::Mat &image, int levels, PyramidBuffers &pyramid)
+{
+    pyramid.storage.resize(levels + 1);
+    pyramid.levels.resize(levels + 1);
+    const int type = CV_MAKETYPE(CV_32F, image.channels());
+    cv::Size size = image.size();
+    for (int i = 0; i <= levels; ++i)
+    {
+        pyramid.levels[i] = acquireBuffer(pyramid.storage[i], size, type);
+        size = cv::Size((size.width + 1) / 2, (size.height + 1) / 2);
+    }
+
+    image.convertTo(pyramid.levels[0], CV_32F);
+    for (int i = 0; i < levels; ++i)
+    {
+        cv::pyrDown(pyramid.levels[i], pyramid.levels[i + 1], pyramid.levels[i + 1].size());
+    }
+}
+
+static void buildLaplacianPyramid(const cv::Mat &image, int levels, PyramidBuffers &pyramid, cv::Mat &expandedStorage)
+{
+    buildGaussianPyramid(image, levels, pyramid);
+    for (int i = 0; i < levels; ++i)
+    {
+        cv::Mat expanded = acquireBuffer(expandedStorage, pyramid.levels[i].size(), pyramid.levels[i].type());
+        cv::pyrUp(pyramid.levels[i + 1], expanded, expanded.size());
+        cv::subtract(pyramid.levels[i], expanded, pyramid.levels[i]);
+    }
+}
+
+// Burt & Adelson multi-band blend of image1 (anchored at the top-left of warped) into warped.
+// Both images get a binary weight split along the seam of equal distance to their borders. Their Laplacian
+// pyramids are blended per level with the Gaussian pyramids of those weights, so low frequencies mix over a
+// wide band and fine detail over a narrow one. Only a padded box around the overlap is decomposed.
+// warpedMask marks the canvas pixels image2 covers, derived from the non-zero pixels when empty.
+static void multibandBlend(const cv::Mat &image1, cv::Mat &warped, const cv::Mat &warpedMask, BlendScratch &scratch)
+{
+    CV_Assert(image1.type() == CV_8UC3 && warped.type() == CV_8UC3);
+    const cv::Rect image1Rect = cv::Rect(0, 0, image1.cols, image1.rows) & cv::Rect(0, 0, warped.cols, warped.rows);
+    const cv::Mat mask1 = nonZeroMask(image1(image1Rect), scratch.mask1);
+    const cv::Mat mask2 = warpedMask.empty() ? nonZeroMask(warped, scratch.mask2) : warpedMask;
+
+    cv::Mat overlap = acquireBuffer(scratch.overlap, image1Rect.size(), CV_8U);
+    cv::bitwise_and(mask1, mask2(image1Rect), overlap);
+    const cv::Rect overlapBox = cv::boundingRect(overlap);
+
+    // Outside the overlap this is OVERLAY restricted to image1's non-zero pixels
+    image1(image1Rect).copyTo(warped(image1Rect), mask1);
+    if (overlapBox.empty())
+        return;
+
+    // Pad by the support of the coarsest level so the low bands have room to spread
+    const int maxBands = 5;
+    const int padding = 1 << maxBands;
+    const cv::Rect roi = cv::Rect(overlapBox.x - padding, overlapBox.y - padding, overlapBox.width + 2 * padding, overlapBox.height + 2 * padding) &
+                         cv::Rect(0, 0, warped.cols, warped.rows);
+    int levels = maxBands;
+    while (levels > 0 && (std::min(roi.width, roi.height) >> levels) < 2)
+        --levels;
+
+    // The ROI may reach past image1, where image1 contributes nothing
+    cv::Mat roi1 = acquireBuffer(scratch.roi1, roi.size(), CV_8UC3), roiMask1 = acquireBuffer(scratch.roiMask1, roi.size(), CV_8U);
+    roi1.setTo(cv::Scalar::all(0));
+    roiMask1.setTo(cv::Scalar::all(0));
+    const cv::Rect inside = roi & image1Rect;
+    image1(inside).copyTo(roi1(inside - roi.tl()));
+    mask1(inside).copyTo(roiMask1(inside - roi.tl()));
+    cv::Mat roi2 = acquireBuffer(scratch.roi2, roi.size(), CV_8UC3);
+    warped(roi).copyTo(roi2);
+    const cv::Mat roiMask2 = mask2(roi);
+
+    // Seam: each pixel of the overlap goes to the image whose border is further away
+    cv::Mat distance1 = acquireBuffer(scratch.distance1, roi.size(), CV_32F), distance2 = acquireBuffer(scratch.distance2, roi.size(), CV_32F);
+    cv::distanceTransform(roiMask1, distance1, cv::DIST_L2, 3);
+    cv::distanceTransform(roiMask2, distance2, cv::DIST_L2, 3);
+    cv::Mat weight1 = acquireBuffer(scratch.weight1, roi.size(), CV_32F), weight2 = acquireBuffer(scratch.weight2, roi.size(), CV_32F);
+    for (int y = 0; y < roi.height; ++y)
+    {
+        const uchar *m1 = roiMask1.ptr<uchar>(y);
+        const uchar *m2 = roiMask2.ptr<uchar>(y);
+        const float *dist1 = distance1.ptr<float>(y);
+        const float *dist2 = distance2.ptr<float>(y);
+        float *w1 = weight1.ptr<float>(y);
+        float *w2 = weight2.ptr<float>(y);
+        for (int x = 0; x < roi.width; ++x)
+        {
+            const bool first = m1[x] && (!m2[x] || dist1[x] >= dist2[x]);
+            w1[x] = first ? 1.0f : 0.0f;
+            w2[x] = !first && m2[x] ? 1.0f : 0.0f;
+        }
+    }
+
+    // The four pyramids are independent, build them concurrently
+    cv::parallel_for_(cv::Range(0, 4), [&](const cv::Range &range)
+    {
+        for (int job = range.start; job < range.end; ++job)
+        {
+            switch (job)
+            {
+            case 0: buildLaplacianPyramid(roi1, levels, scratch.laplacian1, scratch.expanded1); break;
+            case 1: buildLaplacianPyramid(roi2, levels, scratch.laplacian2, scratch.expanded2); break;
+            case 2: buildGaussianPyramid(weight1, levels, scratch.weights1); break;
+            case 3: buildGaussianPyramid(weight2, levels, scratch.weights2); break;
+            }
+        }
+    });
+
+    // Weighted sum per level, normalized by the total weight, written into laplacian1
+    for (int level = 0; level <= levels; ++level)
+    {
+        cv::Mat &blended = scratch.laplacian1.levels[level];
+        const cv::Mat &other = scratch.laplacian2.levels[level];
+        const cv::Mat &g1 = scratch.weights1.levels[level];
+        const cv::Mat &g2 = scratch.weights2.levels[level];
+        cv::parallel_for_(cv::Range(0, blended.rows), [&](const cv::Range &range)
+        {
+            for (int y = range.start; y < range.end; ++y)
+            {
+                float *l1 = blended.ptr<float>(y);
+                const float *l2 = other.ptr<float>(y);
+                const float *w1 = g1.ptr<float>(y);
+                const float *w2 = g2.ptr<float>(y);
+                for (int x = 0; x < blended.cols; ++x)
+                {
+                    const float norm = 1.0f / (w1[x] + w2[x] + 1e-5f);
+                    for (int c = 0; c < 3; ++c)
+                    {
+                        l1[3 * x + c] = (l1[3 * x + c] * w1[x] + l2[3 * x + c] * w2[x]) * norm;
+                    }
+                }
+            }
+        });
+    }
+
+    // Collapse from the coarsest level
+    for (int level = levels - 1; level >= 0; --level)
+    {
+        cv::Mat &current = scratch.laplacian1.levels[level];
+        cv::Mat expanded = acquireBuffer(scratch.expanded1, current.size(), current.type());
+        cv::pyrUp(scratch.laplacian1.levels[level + 1], expanded, expanded.size());
+        cv::add(current, expanded, current);
+    }
+
+    cv::Mat covered = acquireBuffer(scratch.covered, roi.size(), CV_8U), result = acquireBuffer(scratch.result, roi.size(), CV_8UC3);
+    cv::bitwise_or(roiMask1, roiMask2, covered);
+    scratch.laplacian1.levels[0].convertTo(result, CV_8U);
+    result.copyTo(warped(roi), covered);
+}
+
+cv::Mat stitchImages(cv::Mat image1, cv::Mat image2, cv::Mat H, StitchingMethod method, StitchingTimings *timings, PipelineContext *context)
 {
 
     // Create (warped) images of same size
@@ -77,12 +460,24 @@ cv::Mat stitchImages(cv::Mat image1, cv::Mat image2, cv::Mat H, StitchingMethod
     h2 = image2.rows;
     w2 = image2.cols;
 
+    // With a context the canvas is a view of its buffer, so the result lives until the context's next stitch
+    static thread_local BlendScratch threadScratch;
+    BlendScratch &scratch = context ? context->blend : threadScratch;
+    if (context)
+    {
+        stitchedImage = acquireBuffer(context->canvas, cv::Size(w1 + w2, std::max(h1, h2)), image2.type());
+    }
+
+    StitchingTimings stageTimes = {0.0, 0.0, 0.0};
+    auto stageStart = std::chrono::high_resolution_clock::now();
     cv::warpPerspective(image2, stitchedImage, H, cv::Size(w1 + w2, std::max(h1, h2)));
+    stageTimes.warpTimeMs = elapsedMs("warp", stageStart);
 
     switch (method)
     {
     case StitchingMethod::OVERLAY:
     {
+        stageStart = std::chrono::high_resolution_clock::now();
         for (int y = 0; y < h1; y++)
         {
             for (int x = 0; x < w1; x++)
@@ -90,10 +485,33 @@ cv::Mat stitchImages(cv::Mat image1, cv::Mat image2, cv::Mat H, StitchingMethod
                 stitchedImage.at<cv::Vec3b>(y, x) = image1.at<cv::Vec3b>(y, x);
             }
         }
+        stageTimes.blendTimeMs = elapsedMs("blend", stageStart);
         break;
     }
     case StitchingMethod::FEATHERING:
     {
+        CV_Assert(image1.type() == CV_8UC3 && stitchedImage.type() == CV_8UC3);
+
+        int minX, maxX;
+        stageStart = std::chrono::high_resolution_clock::now();
+        findOverlapExtent(image1, stitchedImage, minX, maxX, scratch);
+        stageTimes.overlapTimeMs = elapsedMs("overlap", stageStart);
+
+        stageStart = std::chrono::high_resolution_clock::now();
+        featherBlend(image1, stitchedImage, minX, maxX, scratch);
+        stageTimes.blendTimeMs = elapsedMs("blend", stageStart);
+        break;
+    }
+    case StitchingMethod::MULTIBAND:
+    {
+        stageStart = std::chrono::high_resolution_clock::now();
+        multibandBlend(image1, stitchedImage, cv::Mat(), scratch);
+        stageTimes.blendTimeMs = elapsedMs("blend", stageStart);
+        break;
+    }
+    case StitchingMethod::FEATHERING_LEGACY:
+    {
+        stageStart = std::chrono::high_resolution_clock::now();
         cv::Mat image1Expanded = cv::Mat::zeros(stitchedImage.rows, stitchedImage.cols, image1.type());
         {
             for (int y = 0; y < h1; y++)
@@ -139,8 +557,10 @@ cv::Mat stitchImages(cv::Mat image1, cv::Mat image2, cv::Mat H, StitchingMethod
                 }
             }
         }
+        stageTimes.overlapTimeMs = elapsedMs("overlap", stageStart);
 
         // Blend images
+        stageStart = std::chrono::high_resolution_clock::now();
         for (int y = 0; y < stitchedImage.rows; y++)
         {
             for (int x = 0; x < stitchedImage.cols; x++)
@@ -148,6 +568,7 @@ cv::Mat stitchImages(cv::Mat image1, cv::Mat image2, cv::Mat H, StitchingMethod
                 stitchedImage.at<cv::Vec3b>(y, x) = image1Expanded.at<cv::Vec3b>(y, x) * d1(x, minX, maxX) + stitchedImage.at<cv::Vec3b>(y, x) * d2(x, minX, maxX);
             }
         }
+        stageTimes.blendTimeMs = elapsedMs("blend", stageStart);
         break;
     }
     default:
@@ -156,6 +577,255 @@ cv::Mat stitchImages(cv::Mat image1, cv::Mat image2, cv::Mat H, StitchingMethod
     }
 
     }
+
+    if (timings)
+    {
+        *timings = stageTimes;
+    }
     
     return stitchedImage;
-};
\ No newline at end of file
+};
+WarpPlan createWarpPlan(const cv::Mat &H, cv::Size image1Size, cv::Size image2Size)
+{
+    WarpPlan plan;
+    H.convertTo(plan.H, CV_64F);
+    plan.image1Size = image1Size;
+    plan.image2Size = image2Size;
+    plan.canvasSize = cv::Size(image1Size.width + image2Size.width, std::max(image1Size.height, image2Size.height));
+
+    // Same inverse mapping warpPerspective performs per call: canvas pixel -> source pixel of image2
+    cv::Mat inverse = plan.H.inv();
+    const double *M = inverse.ptr<double>();
+    cv::Mat mapX(plan.canvasSize, CV_32F), mapY(plan.canvasSize, CV_32F);
+    plan.validMask = cv::Mat::zeros(plan.canvasSize, CV_8U);
+    const float maxX = static_cast<float>(image2Size.width - 1), maxY = static_cast<float>(image2Size.height - 1);
+
+    cv::parallel_for_(cv::Range(0, plan.canvasSize.height), [&](const cv::Range &range)
+    {
+        for (int y = range.start; y < range.end; ++y)
+        {
+            float *rowX = mapX.ptr<float>(y);
+            float *rowY = mapY.ptr<float>(y);
+            uchar *valid = plan.validMask.ptr<uchar>(y);
+            for (int x = 0; x < plan.canvasSize.width; ++x)
+            {
+                double W = M[6] * x + M[7] * y + M[8];
+                float sx = -1.0f, sy = -1.0f;
+                if (W != 0.0)
+                {
+                    W = 1.0 / W;
+                    sx = static_cast<float>((M[0] * x + M[1] * y + M[2]) * W);
+                    sy = static_cast<float>((M[3] * x + M[4] * y + M[5]) * W);
+                }
+                rowX[x] = sx;
+                rowY[x] = sy;
+                valid[x] = sx >= 0.0f && sy >= 0.0f && sx <= maxX && sy <= maxY ? 255 : 0;
+            }
+        }
+    });
+    cv::convertMaps(mapX, mapY, plan.map1, plan.map2, CV_16SC2);
+
+    cv::Rect image1Rect(0, 0, image1Size.width, image1Size.height);
+    cv::Rect box = cv::boundingRect(plan.validMask(image1Rect));
+    plan.overlapBox = box;
+    return plan;
+}
+
+cv::Mat stitchImages(const WarpPlan &plan, const cv::Mat &image1, const cv::Mat &image2, StitchingMethod method, StitchingTimings *timings,
+                     PipelineContext *context)
+{
+    if (image1.size() != plan.image1Size || image2.size() != plan.image2Size)
+    {
+        throw std::invalid_argument("Image sizes do not match the warp plan");
+    }
+    if (method == StitchingMethod::FEATHERING_LEGACY)
+    {
+        // The legacy per-pixel blend exists to check the fast path against; it has no plan-based variant
+        throw std::invalid_argument("FEATHERING_LEGACY is not supported with a warp plan");
+    }
+
+    static thread_local BlendScratch threadScratch;
+    BlendScratch &scratch = context ? context->blend : threadScratch;
+
+    StitchingTimings stageTimes = {0.0, 0.0, 0.0};
+    auto stageStart = std::chrono::high_resolution_clock::now();
+    cv::Mat stitchedImage;
+    if (context)
+    {
+        stitchedImage = acquireBuffer(context->canvas, plan.canvasSize, image2.type());
+    }
+    cv::remap(image2, stitchedImage, plan.map1, plan.map2, cv::INTER_LINEAR, cv::BORDER_CONSTANT);
+    stageTimes.warpTimeMs = elapsedMs("warp", stageStart);
+
+    stageStart = std::chrono::high_resolution_clock::now();
+    switch (method)
+    {
+    case StitchingMethod::OVERLAY:
+    {
+        image1.copyTo(stitchedImage(cv::Rect(0, 0, image1.cols, image1.rows)));
+        break;
+    }
+    case StitchingMethod::FEATHERING:
+    {
+        CV_Assert(image1.type() == CV_8UC3 && stitchedImage.type() == CV_8UC3);
+
+        // The overlap comes from the plan's geometry instead of a scan over the pixel values
+        int minX = stitchedImage.cols, maxX = 0;
+        if (!plan.overlapBox.empty())
+        {
+            minX = plan.overlapBox.x;
+            maxX = plan.overlapBox.x + plan.overlapBox.width - 1;
+        }
+        featherBlend(image1, stitchedImage, minX, maxX, scratch);
+        break;
+    }
+    case StitchingMethod::MULTIBAND:
+    {
+        multibandBlend(image1, stitchedImage, plan.validMask, scratch);
+        break;
+    }
+    default:
+    {
+        throw std::invalid_argument("Unknown stitching method");
+    }
+    }
+    stageTimes.blendTimeMs = elapsedMs("blend", stageStart);
+
+    if (timings)
+    {
+        *timings = stageTimes;
+    }
+    return stitchedImage;
+}
+
+// True when H maps image2's corners within tolerancePx of where the plan's homography maps them,
+// so the plan can keep serving a rig whose re-estimated H only jitters
+bool warpPlanMatches(const WarpPlan &plan, const cv::Mat &H, cv::Size image1Size, cv::Size image2Size, double tolerancePx)
+{
+    if (plan.H.empty() || H.empty() || plan.image1Size != image1Size || plan.image2Size != image2Size)
+        return false;
+
+    const float w = static_cast<float>(image2Size.width), h = static_cast<float>(image2Size.height);
+    std::vector<cv::Point2f> corners = {{0, 0}, {w, 0}, {w, h}, {0, h}}, planCorners, newCorners;
+    cv::Mat H64;
+    H.convertTo(H64, CV_64F);
+    cv::perspectiveTransform(corners, planCorners, plan.H);
+    cv::perspectiveTransform(corners, newCorners, H64);
+    for (size_t i = 0; i < corners.size(); ++i)
+    {
+        if (cv::norm(planCorners[i] - newCorners[i]) > tolerancePx)
+            return false;
+    }
+    return true;
+}
+
+namespace
+{
+const char WARP_PLAN_MAGIC[8] = {'V', 'C', 'W', 'P', 'L', 'A', 'N', '\0'};
+const std::uint32_t WARP_PLAN_VERSION = 1;
+
+void writeMat(std::ofstream &file, const cv::Mat &mat)
+{
+    CV_Assert(mat.isContinuous());
+    file.write(reinterpret_cast<const char *>(mat.data), mat.total() * mat.elemSize());
+}
+
+void readMat(std::ifstream &file, cv::Mat &mat, cv::Size size, int type)
+{
+    mat.create(size, type);
+    file.read(reinterpret_cast<char *>(mat.data), mat.total() * mat.elemSize());
+}
+}
+
+// Binary layout: magic, version, H (9 doubles), image1/image2/canvas sizes and overlap box (int32),
+// then map1, map2 and validMask as raw rows
+void saveWarpPlan(const WarpPlan &plan, const std::string &path)
+{
+    // Written to a temporary file and renamed, so a crash mid-write never leaves a truncated plan at path
+    const std::string tmpPath = uniqueTemporaryPath(path);
+    std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+    if (!file)
+    {
+        throw std::runtime_error("Could not write warp plan " + tmpPath);
+    }
+
+    file.write(WARP_PLAN_MAGIC, sizeof(WARP_PLAN_MAGIC));
+    file.write(reinterpret_cast<const char *>(&WARP_PLAN_VERSION), sizeof(WARP_PLAN_VERSION));
+    file.write(reinterpret_cast<const char *>(plan.H.ptr<double>()), 9 * sizeof(double));
+    const std::int32_t dims[10] = {plan.image1Size.width, plan.image1Size.height, plan.image2Size.width, plan.image2Size.height,
+                                   plan.canvasSize.width, plan.canvasSize.height,
+                                   plan.overlapBox.x, plan.overlapBox.y, plan.overlapBox.width, plan.overlapBox.height};
+    file.write(reinterpret_cast<const char *>(dims), sizeof(dims));
+    writeMat(file, plan.map1);
+    writeMat(file, plan.map2);
+    writeMat(file, plan.validMask);
+    file.close();
+
+    std::error_code ec;
+    if (!file)
+    {
+        std::filesystem::remove(tmpPath, ec);
+        throw std::runtime_error("Could not write warp plan " + tmpPath);
+    }
+    std::filesystem::rename(tmpPath, path, ec);
+    if (ec)
+    {
+        std::filesystem::remove(tmpPath, ec);
+        throw std::runtime_error("Could not store warp plan " + path);
+    }
+}
+
+WarpPlan loadWarpPlan(const std::string &path)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        throw std::runtime_error("Could not open warp plan " + path);
+    }
+
+    char magic[8];
+    std::uint32_t version = 0;
+    file.read(magic, sizeof(magic));
+    file.read(reinterpret_cast<char *>(&version), sizeof(version));
+    if (!file || std::memcmp(magic, WARP_PLAN_MAGIC, sizeof(magic)) != 0 || version != WARP_PLAN_VERSION)
+    {
+        throw std::runtime_error("Not a warp plan: " + path);
+    }
+
+    WarpPlan plan;
+    plan.H.create(3, 3, CV_64F);
+    file.read(reinterpret_cast<char *>(plan.H.ptr<double>()), 9 * sizeof(double));
+    std::int32_t dims[10];
+    file.read(reinterpret_cast<char *>(dims), sizeof(dims));
+    plan.image1Size = cv::Size(dims[0], dims[1]);
+    plan.image2Size = cv::Size(dims[2], dims[3]);
+    plan.canvasSize = cv::Size(dims[4], dims[5]);
+    plan.overlapBox = cv::Rect(dims[6], dims[7], dims[8], dims[9]);
+    // Checked before the maps are allocated: createWarpPlan always lays out a (w1 + w2) x max(h1, h2) canvas
+    const bool validSizes = plan.image1Size.width > 0 && plan.image1Size.height > 0 && plan.image2Size.width > 0 && plan.image2Size.height > 0 &&
+                            plan.image1Size.width <= std::numeric_limits<std::int32_t>::max() - plan.image2Size.width &&
+                            plan.canvasSize == cv::Size(plan.image1Size.width + plan.image2Size.width, std::max(plan.image1Size.height, plan.image2Size.height));
+    if (!file || !validSizes || (plan.overlapBox & cv::Rect(cv::Point(), plan.canvasSize)) != plan.overlapBox || !cv::checkRange(plan.H))
+    {
+        throw std::runtime_error("Corrupt warp plan " + path);
+    }
+
+    // map1 (4 bytes), map2 (2) and validMask (1) per canvas pixel must be exactly what is left of the file
+    const std::streamoff position = file.tellg();
+    file.seekg(0, std::ios::end);
+    const std::streamoff remaining = file.tellg() - position;
+    file.seekg(position);
+    if (!file || remaining != static_cast<std::streamoff>(plan.canvasSize.width) * plan.canvasSize.height * 7)
+    {
+        throw std::runtime_error("Truncated warp plan " + path);
+    }
+
+    readMat(file, plan.map1, plan.canvasSize, CV_16SC2);
+    readMat(file, plan.map2, plan.canvasSize, CV_16UC1);
+    readMat(file, plan.validMask, plan.canvasSize, CV_8UC1);
+    if (!file)
+    {
+        throw std::runtime_error("Truncated warp plan " + path);
+    }
+    return plan;
+}
@@ -4,20 +4,71 @@
 #include <chrono>
 #include "featureDetection.h"
 
+struct PipelineContext;
+struct BlendScratch;
 
 struct HomographyEstimation {
     cv::Mat H;
     int numInliers;
     float estimationTimeMs;
     float alignmentError;
+    // 0 when the solver does not report them
+    int iterations;
+    float timePerIterationUs;
 };
 
 enum class StitchingMethod {
     OVERLAY,
-    FEATHERING
+    FEATHERING,
+    FEATHERING_LEGACY,
+    // Laplacian pyramid blending around a distance-transform seam
+    MULTIBAND
 };
 
-HomographyEstimation estimateHomography(std::vector<cv::KeyPoint> keypoints1, std::vector<cv::KeyPoint> keypoints2, FeatureMatches matches, float threshold);
-cv::Mat stitchImages(cv::Mat image1, cv::Mat image2, cv::Mat H, StitchingMethod method = StitchingMethod::OVERLAY);
-float d1(int x, int imageWidth);
-float d2(int x, int imageWidth);
+struct StitchingTimings {
+    double warpTimeMs;
+    double overlapTimeMs;
+    double blendTimeMs;
+};
+
+// Everything stitchImages derives from H and the image sizes, computed once for a fixed camera rig:
+// fixed-point remap tables for image2, the canvas pixels image2 covers and the overlap with image1.
+struct WarpPlan {
+    cv::Mat H;
+    cv::Size image1Size;
+    cv::Size image2Size;
+    cv::Size canvasSize;
+    // cv::convertMaps output: CV_16SC2 integer coordinates and CV_16UC1 interpolation table indices
+    cv::Mat map1;
+    cv::Mat map2;
+    cv::Mat validMask;
+    cv::Rect overlapBox;
+};
+
+// H is empty, with numInliers 0 and an infinite alignmentError, when the matches do not determine a homography
+HomographyEstimation estimateHomography(const std::vector<cv::KeyPoint> &keypoints1, const std::vector<cv::KeyPoint> &keypoints2, const FeatureMatches &matches, float threshold);
+HomographyEstimation estimateHomography(const FeatureSet &features1, const FeatureSet &features2, const MatchSet &matches, float threshold);
+// Same, gathering the points into buffers the context keeps between pairs
+HomographyEstimation estimateHomography(const FeatureSet &features1, const FeatureSet &features2, const MatchSet &matches, float threshold,
+                                        PipelineContext &context);
+void recordEstimationMetrics(const HomographyEstimation &estimation);
+// Mean L1 reprojection residual |H * points1[i] - points2[i]| in pixels of image 2, over all correspondences
+float computeAlignmentError(const std::vector<cv::Point2f> &points1, const std::vector<cv::Point2f> &points2, const cv::Mat &H);
+// With a context, the canvas and blend buffers are views of its storage and the result is overwritten by its next stitch
+cv::Mat stitchImages(cv::Mat image1, cv::Mat image2, cv::Mat H, StitchingMethod method = StitchingMethod::OVERLAY, StitchingTimings *timings = nullptr,
+                     PipelineContext *context = nullptr);
+WarpPlan createWarpPlan(const cv::Mat &H, cv::Size image1Size, cv::Size image2Size);
+// FEATHERING_LEGACY is rejected with std::invalid_argument, the plan path only has the fast blend
+cv::Mat stitchImages(const WarpPlan &plan, const cv::Mat &image1, const cv::Mat &image2, StitchingMethod method = StitchingMethod::OVERLAY, StitchingTimings *timings = nullptr,
+                     PipelineContext *context = nullptr);
+bool warpPlanMatches(const WarpPlan &plan, const cv::Mat &H, cv::Size image1Size, cv::Size image2Size, double tolerancePx = 0.5);
+// Replaces path atomically through a temporary file
+void saveWarpPlan(const WarpPlan &plan, const std::string &path);
+// Throws std::runtime_error for a file that is not a complete, consistent plan
+WarpPlan loadWarpPlan(const std::string &path);
+// Linear blend of image1 (anchored at the top-left of warped) into warped over the columns [minX, maxX]
+void featherBlend(const cv::Mat &image1, cv::Mat &warped, int minX, int maxX);
+// Same, with the per-column weights kept in scratch
+void featherBlend(const cv::Mat &image1, cv::Mat &warped, int minX, int maxX, BlendScratch &scratch);
+float d1(int x, int overlapStart, int overlapEnd);
+float d2(int x, int overlapStart, int overlapEnd);